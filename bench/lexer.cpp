@@ -0,0 +1,77 @@
+#include "lexer.hpp"
+
+#include "parser.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+
+/// @brief Operações com ids, nomes e modificadores de tamanhos variados, todas
+/// em uma única linha.
+static auto makeInput(sgbd::usize bytes, unsigned seed) -> std::string
+{
+  static constexpr const char* names[] = { "x", "y", "z", "clientes", "pedidosdevenda", "estoque" };
+  static constexpr const char* mods[] = { "", "", " updl", " pagl", " tabl", " arel", " rowl" };
+
+  std::mt19937 rng(seed);
+  std::string input;
+  input.reserve(bytes + 64);
+  while (input.size() < bytes)
+  {
+    auto tr = std::to_string(rng() % 100000);
+    switch (rng() % 4)
+    {
+      case 0:  input += "c" + tr; break;
+      case 1:  input += "w" + tr + "(" + names[rng() % 6] + ":" + std::to_string(rng() % 5000) + ")"; break;
+      default: input += "r" + tr + "(" + names[rng() % 6] + ":" + std::to_string(rng() % 5000) +
+                        mods[rng() % 7] + ")"; break;
+    }
+  }
+  return input;
+}
+
+void lexerBenchmark(sgbd::usize bytes, unsigned seed, bool json)
+{
+  auto input = makeInput(bytes, seed);
+  constexpr int Rounds = 5;
+
+  // referência: uma passada que só lê cada byte
+  auto start = std::chrono::steady_clock::now();
+  sgbd::usize parens = 0;
+  for (int i = 0; i < Rounds; i++)
+    parens += std::count(input.begin(), input.end(), '(');
+  std::chrono::duration<double> scanTime = std::chrono::steady_clock::now() - start;
+
+  start = std::chrono::steady_clock::now();
+  sgbd::usize tokens = 0;
+  for (int i = 0; i < Rounds; i++)
+  {
+    sgbd::Parser parser(input);
+    while (parser.consume().type != sgbd::Parser::TokenType::Eof)
+      tokens++;
+  }
+  std::chrono::duration<double> lexTime = std::chrono::steady_clock::now() - start;
+
+  double mb = double(input.size()) * Rounds / (1 << 20);
+  if (json)
+  {
+    std::cout
+      << "{\"bytes\": " << input.size()
+      << ", \"tokens\": " << tokens / Rounds
+      << ", \"tokens_per_sec\": " << sgbd::usize(tokens / lexTime.count())
+      << ", \"lexer_mb_per_sec\": " << sgbd::usize(mb / lexTime.count())
+      << ", \"scan_mb_per_sec\": " << sgbd::usize(mb / scanTime.count())
+      << ", \"checksum\": " << parens << "}\n";
+    return;
+  }
+
+  std::cout
+    << std::fixed << std::setprecision(0)
+    << "entrada:   " << input.size() << " bytes, " << tokens / Rounds << " tokens\n"
+    << "lexer:     " << tokens / lexTime.count() << " tokens/s, "
+    << mb / lexTime.count() << " MB/s\n"
+    << "leitura:   " << mb / scanTime.count() << " MB/s (checksum " << parens << ")\n";
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include "common.hpp"
+
+/// @brief Mede a vazão do analisador léxico (Parser) em uma linha sintética
+/// com `bytes` bytes de operações, comparada com uma leitura simples do mesmo
+/// buffer (limite imposto pela memória).
+/// @param bytes Tamanho aproximado da entrada.
+/// @param seed Semente do gerador.
+/// @param json true para imprimir em JSON.
+void lexerBenchmark(sgbd::usize bytes, unsigned seed, bool json);
@@ -0,0 +1,596 @@
+#include "async_scheduler.hpp"
+#include "deadlock_detector.hpp"
+#include "lexer.hpp"
+#include "scheduler.hpp"
+#include "serializability.hpp"
+#include "sharded_scheduler.hpp"
+#include "table.hpp"
+#include "transaction.hpp"
+#include "workload.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <coroutine>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+using Policy = sgbd::Scheduler::DeadlockPolicy;
+
+/// @brief Resultado de uma execução da carga.
+struct Result
+{
+  std::string_view policy;
+  sgbd::usize threads;
+  double opsPerSec;
+  double p50; ///< Latência por operação em microssegundos.
+  double p99;
+  sgbd::usize emitted;
+  sgbd::usize commits;
+  sgbd::usize aborts;
+  sgbd::usize pending;
+  double abortRate;
+  sgbd::usize peakLocks;
+  std::optional<sgbd::usize> peakGraph; ///< Só amostrado com uma thread e sem shards.
+  bool serializable;
+  sgbd::usize distributedCommits = 0;   ///< Só com shards.
+  sgbd::usize globalDeadlocks = 0;
+};
+
+static double percentile(std::vector<double>& sorted, double p)
+{
+  if (sorted.empty())
+    return 0.0;
+  auto i = std::min<sgbd::usize>(sgbd::usize(p * sorted.size()), sorted.size() - 1);
+  return sorted[i];
+}
+
+/// @brief Escalona a carga com `threads` threads; cada transação é enviada
+/// por uma única thread, na ordem gerada. Mede a latência de cada chamada a
+/// schedule e confere se o escalonamento emitido é serializável.
+/// @tparam Sched Scheduler ou ShardedScheduler (com w.shards e w.routing).
+/// @param batched Só com Scheduler: cada transação é enviada inteira, ao
+/// chegar o seu commit, por um único scheduleBatch (uma latência por lote).
+template <class Sched>
+Result run(const Workload& w, const std::vector<GeneratedOp>& ops, Policy policy,
+  std::string_view name, sgbd::usize threads, bool batched = false)
+{
+  constexpr bool sharded = std::is_same_v<Sched, sgbd::ShardedScheduler>;
+
+  sgbd::ResourceManager resManager;
+  sgbd::TimestampOracle oracle(w.timestamps);
+  sgbd::TransactionManager trManager;
+  trManager.setTimestampOracle(&oracle);
+  populateData(resManager, w);
+  auto tables = tablesOf(resManager, w);
+
+  // os shards são divididos a partir das tabelas já criadas
+  std::unique_ptr<Sched> owned;
+  if constexpr (sharded)
+    owned = std::make_unique<Sched>(resManager, w.shards, w.routing, policy);
+  else
+    owned = std::make_unique<Sched>(policy);
+  auto& scheduler = *owned;
+
+  std::vector<std::vector<double>> latencies(threads);
+  std::vector<sgbd::usize> peakLocks(threads, 0);
+  sgbd::usize peakGraph = 0;
+
+  auto drive = [&](sgbd::usize t)
+  {
+    auto& latency = latencies[t];
+    latency.reserve(ops.size() / threads + 1);
+    std::unordered_map<sgbd::usize, std::vector<sgbd::Operation>> batches;
+    for (auto& g : ops)
+    {
+      if (g.trid % threads != t)
+        continue;
+
+      auto op = makeOperation(g, w, trManager, tables);
+      auto start = std::chrono::steady_clock::now();
+      if constexpr (!sharded)
+      {
+        if (batched)
+        {
+          auto& batch = batches[g.trid];
+          batch.push_back(op);
+          if (g.kind != 3)
+            continue;
+
+          start = std::chrono::steady_clock::now();
+          scheduler.scheduleBatch(batch);
+          batches.erase(g.trid);
+        }
+        else scheduler.schedule(op);
+      }
+      else scheduler.schedule(op);
+      std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+      latency.push_back(elapsed.count());
+
+      peakLocks[t] = std::max(peakLocks[t], scheduler.getLockCount());
+      // o grafo não é sincronizado com schedule
+      if constexpr (!sharded)
+        if (threads == 1)
+          peakGraph = std::max(peakGraph, scheduler.getWaitForGraph().size());
+    }
+  };
+
+  auto start = std::chrono::steady_clock::now();
+  if (threads == 1)
+    drive(0);
+  else
+  {
+    // uma thread parada esperando não escalona mais nada, então a detecção
+    // periódica é conferida também pelo detector
+    std::optional<sgbd::DeadlockDetector> detector;
+    if (sharded || policy == Policy::Periodic)
+      detector.emplace(scheduler.getDetection().interval, [&] { scheduler.tick(); });
+
+    std::vector<std::thread> workers;
+    for (sgbd::usize t = 0; t < threads; t++)
+      workers.emplace_back(drive, t);
+    for (auto& worker : workers)
+      worker.join();
+  }
+
+  // esperas ainda não verificadas pela detecção periódica; ciclos entre
+  // shards podem sobrar com qualquer política
+  if (sharded || policy == Policy::Periodic)
+    while (scheduler.detectDeadlocks()) {}
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  sgbd::usize commits = 0, pending = 0;
+  for (sgbd::usize id = 1; id <= w.transactions; id++)
+  {
+    auto tr = trManager.get(id);
+    commits += tr->committed;
+    pending += !tr->committed && !tr->aborted;
+  }
+
+  std::vector<double> all;
+  all.reserve(ops.size());
+  for (auto& latency : latencies)
+    all.insert(all.end(), latency.begin(), latency.end());
+  std::sort(all.begin(), all.end());
+
+  sgbd::usize aborts = scheduler.getStats().aborts;
+  Result result {
+    name, threads, ops.size() / elapsed.count(),
+    percentile(all, 0.50), percentile(all, 0.99),
+    scheduler.getStats().emitted, commits, aborts, pending,
+    double(aborts) / w.transactions,
+    *std::max_element(peakLocks.begin(), peakLocks.end()),
+    !sharded && threads == 1 ? std::optional(peakGraph) : std::nullopt,
+    isSerializable(scheduler.getScheduling()),
+  };
+  if constexpr (sharded)
+  {
+    result.distributedCommits = scheduler.getStats().distributedCommits;
+    result.globalDeadlocks = scheduler.getStats().globalDeadlocks;
+  }
+  return result;
+}
+
+/// @brief Corrotina sem retorno que se destrói ao terminar.
+struct Detached
+{
+  struct promise_type
+  {
+    Detached get_return_object() { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+};
+
+/// @brief Escalona a carga com AsyncScheduler numa única thread, como um
+/// laço de eventos: cada transação é uma corrotina que envia a próxima
+/// operação quando a anterior completou e a sua vez na ordem gerada já
+/// passou. A latência vai do envio da operação até a sua conclusão, incluindo
+/// a espera por bloqueios.
+Result runAsync(const Workload& w, const std::vector<GeneratedOp>& ops, Policy policy,
+  std::string_view name)
+{
+  sgbd::ResourceManager resManager;
+  sgbd::TimestampOracle oracle(w.timestamps);
+  sgbd::TransactionManager trManager;
+  sgbd::Scheduler scheduler(policy);
+  sgbd::AsyncScheduler async(scheduler);
+  trManager.setTimestampOracle(&oracle);
+  populateData(resManager, w);
+  auto tables = tablesOf(resManager, w);
+
+  std::vector<sgbd::Operation> emitted;
+  async.setOutput({ [&](const sgbd::Operation& op) { emitted.push_back(op); }, {}, {} });
+
+  // vezes que chegaram enquanto a transação esperava uma operação
+  struct Client
+  {
+    std::coroutine_handle<> turn; ///< Esperando a próxima vez.
+    sgbd::usize turns = 0;
+    bool done = false;
+  };
+
+  struct Turn
+  {
+    Client& client;
+
+    bool await_ready() { return client.turns ? (client.turns--, true) : false; }
+    void await_suspend(std::coroutine_handle<> handle) { client.turn = handle; }
+    void await_resume() {}
+  };
+
+  std::vector<Client> clients(w.transactions + 1);
+  std::vector<std::vector<const GeneratedOp*>> byTransaction(w.transactions + 1);
+  for (auto& g : ops)
+    byTransaction[g.trid].push_back(&g);
+
+  std::vector<double> latency;
+  latency.reserve(ops.size());
+  sgbd::usize peakLocks = 0, peakGraph = 0, active = 0;
+
+  auto transaction = [&](sgbd::usize trid) -> Detached
+  {
+    auto& client = clients[trid];
+    active++;
+    for (auto g : byTransaction[trid])
+    {
+      co_await Turn { client };
+
+      auto op = makeOperation(*g, w, trManager, tables);
+      auto start = std::chrono::steady_clock::now();
+      auto outcome = co_await async.submit(op);
+      std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+      latency.push_back(elapsed.count());
+
+      peakLocks = std::max(peakLocks, scheduler.getLockCount());
+      peakGraph = std::max(peakGraph, scheduler.getWaitForGraph().size());
+      if (!outcome.emitted())
+        break;
+    }
+    client.done = true;
+    active--;
+  };
+
+  auto start = std::chrono::steady_clock::now();
+  for (auto& g : ops)
+  {
+    auto& client = clients[g.trid];
+    if (client.done)
+      continue;
+
+    // a primeira vez inicia a corrotina; as outras a retomam se ela já
+    // estiver esperando a vez, senão ficam guardadas
+    client.turns++;
+    if (&g == byTransaction[g.trid].front())
+      transaction(g.trid);
+    else if (auto turn = std::exchange(client.turn, {}))
+    {
+      client.turns--;
+      turn.resume();
+    }
+  }
+
+  // as que sobraram esperam bloqueios presos num ciclo ainda não detectado
+  while (active && async.detectDeadlocks()) {}
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  sgbd::usize commits = 0, pending = 0;
+  for (sgbd::usize id = 1; id <= w.transactions; id++)
+  {
+    auto tr = trManager.get(id);
+    commits += tr->committed;
+    pending += !tr->committed && !tr->aborted;
+  }
+  std::sort(latency.begin(), latency.end());
+
+  sgbd::usize aborts = scheduler.getStats().aborts;
+  return {
+    name, 1, ops.size() / elapsed.count(),
+    percentile(latency, 0.50), percentile(latency, 0.99),
+    scheduler.getStats().emitted, commits, aborts, pending,
+    double(aborts) / w.transactions, peakLocks, peakGraph,
+    isSerializable(emitted),
+  };
+}
+
+static auto granularityName(sgbd::Operation::Resource res) -> std::string_view
+{
+  switch (res)
+  {
+    case sgbd::Operation::Resource::Area:  return "area";
+    case sgbd::Operation::Resource::Table: return "table";
+    case sgbd::Operation::Resource::Page:  return "page";
+    default:                               return "row";
+  }
+}
+
+static auto routingName(sgbd::ShardedScheduler::Routing routing) -> std::string_view
+{
+  return routing == sgbd::ShardedScheduler::Routing::Table ? "table" : "area";
+}
+
+static auto timestampsName(sgbd::TimestampOracle::Mode mode) -> std::string_view
+{
+  switch (mode)
+  {
+    case sgbd::TimestampOracle::Mode::Batched: return "batched";
+    case sgbd::TimestampOracle::Mode::Hybrid:  return "hybrid";
+    default:                                   return "counter";
+  }
+}
+
+void printText(const Workload& w, sgbd::usize opCount, const std::vector<Result>& results)
+{
+  std::cout
+    << "transações: " << w.transactions << ", operações: " << opCount
+    << ", concorrência: " << w.concurrency << ", zipf: " << w.zipf
+    << ", granulosidade: " << granularityName(w.granularity)
+    << ", timestamps: " << timestampsName(w.timestamps);
+  if (w.shards)
+    std::cout
+      << ", shards: " << w.shards << " (" << routingName(w.routing) << ')'
+      << ", áreas: " << w.areas << ", afinidade: " << w.affinity;
+  std::cout << "\n\n"
+    << std::setw(17) << "política"
+    << std::setw(8)  << "threads"
+    << std::setw(12) << "ops/s"
+    << std::setw(10) << "p50 µs"
+    << std::setw(10) << "p99 µs"
+    << std::setw(9)  << "commits"
+    << std::setw(9)  << "abortos"
+    << std::setw(9)  << "taxa"
+    << std::setw(14) << "pico bloq."
+    << std::setw(12) << "pico grafo"
+    << std::setw(11) << "pendentes"
+    << std::setw(15) << "serializável" << '\n';
+
+  for (auto& r : results)
+  {
+    std::cout
+      << std::setw(17) << r.policy
+      << std::setw(8)  << r.threads
+      << std::setw(12) << std::fixed << std::setprecision(0) << r.opsPerSec
+      << std::setw(9)  << std::setprecision(2) << r.p50
+      << std::setw(9)  << r.p99
+      << std::setw(9)  << r.commits
+      << std::setw(9)  << r.aborts
+      << std::setw(8)  << std::setprecision(1) << 100.0 * r.abortRate << '%'
+      << std::setw(12) << r.peakLocks
+      << std::setw(12) << (r.peakGraph ? std::to_string(*r.peakGraph) : "-")
+      << std::setw(11) << r.pending
+      << std::setw(14) << (r.serializable ? "sim" : "NÃO") << '\n';
+  }
+}
+
+void printJson(const Workload& w, sgbd::usize opCount, const std::vector<Result>& results)
+{
+  std::cout
+    << std::setprecision(6) << std::defaultfloat
+    << "{\n  \"workload\": {"
+    << "\"tables\": " << w.tables
+    << ", \"pages\": " << w.pages
+    << ", \"rows_per_page\": " << w.rowsPerPage
+    << ", \"transactions\": " << w.transactions
+    << ", \"ops_per_transaction\": " << w.opsPerTransaction
+    << ", \"concurrency\": " << w.concurrency
+    << ", \"write_ratio\": " << w.writeRatio
+    << ", \"update_ratio\": " << w.updateRatio
+    << ", \"zipf\": " << w.zipf
+    << ", \"granularity\": \"" << granularityName(w.granularity) << '"'
+    << ", \"timestamps\": \"" << timestampsName(w.timestamps) << '"'
+    << ", \"areas\": " << w.areas
+    << ", \"affinity\": " << w.affinity
+    << ", \"shards\": " << w.shards
+    << ", \"routing\": \"" << routingName(w.routing) << '"'
+    << ", \"seed\": " << w.seed
+    << ", \"operations\": " << opCount << "},\n  \"runs\": [";
+
+  for (sgbd::usize i = 0; i < results.size(); i++)
+  {
+    auto& r = results[i];
+    std::cout
+      << (i ? ",\n" : "\n") << "    {"
+      << "\"policy\": \"" << r.policy << '"'
+      << ", \"threads\": " << r.threads
+      << ", \"ops_per_sec\": " << sgbd::usize(r.opsPerSec)
+      << ", \"latency_us\": {\"p50\": " << r.p50 << ", \"p99\": " << r.p99 << '}'
+      << ", \"emitted\": " << r.emitted
+      << ", \"commits\": " << r.commits
+      << ", \"aborts\": " << r.aborts
+      << ", \"abort_rate\": " << r.abortRate
+      << ", \"pending\": " << r.pending
+      << ", \"peak_locks\": " << r.peakLocks
+      << ", \"peak_wait_graph\": " << (r.peakGraph ? std::to_string(*r.peakGraph) : "null")
+      << ", \"serializable\": " << (r.serializable ? "true" : "false");
+    if (w.shards)
+      std::cout
+        << ", \"distributed_commits\": " << r.distributedCommits
+        << ", \"global_deadlocks\": " << r.globalDeadlocks;
+    std::cout << '}';
+  }
+  std::cout << "\n  ]\n}\n";
+}
+
+static void usage()
+{
+  std::cerr <<
+    "uso: bench [opções]\n"
+    "  --transactions N    transações geradas\n"
+    "  --ops N             operações por transação (sem o commit)\n"
+    "  --concurrency N     transações ativas intercaladas\n"
+    "  --tables N          tabelas\n"
+    "  --areas N           áreas (tabela t na área t % N)\n"
+    "  --affinity F        chance de uma operação ir para a área da transação\n"
+    "  --writes F          fração de escritas\n"
+    "  --updates F         fração de leituras com updl\n"
+    "  --zipf F            expoente de Zipf das tabelas (0 = uniforme)\n"
+    "  --granularity G     row, page, table ou area\n"
+    "  --timestamps M      counter, batched ou hybrid\n"
+    "  --seed N            semente do gerador\n"
+    "  --threads N         threads da execução concorrente\n"
+    "  --shards N          escalona com um ShardedScheduler de N shards\n"
+    "  --routing R         area ou table (divisão entre os shards)\n"
+    "  --async             escalona também com AsyncScheduler em uma thread\n"
+    "  --batch             escalona também cada transação com um único scheduleBatch\n"
+    "  --json              saída em JSON\n"
+    "  --lexer N           mede só o analisador léxico com N bytes de entrada\n";
+}
+
+template <class T>
+static bool parse(std::string_view text, T& value)
+{
+  auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+  return ec == std::errc() && end == text.data() + text.size();
+}
+
+int main(int argc, char** argv)
+{
+  Workload w;
+  bool json = false;
+  bool async = false;
+  bool batch = false;
+  sgbd::usize lexerBytes = 0;
+  sgbd::usize threads = std::max<sgbd::usize>(4, std::thread::hardware_concurrency());
+
+  for (int i = 1; i < argc; i++)
+  {
+    std::string_view arg = argv[i];
+    if (arg == "--json")
+    {
+      json = true;
+      continue;
+    }
+    if (arg == "--async")
+    {
+      async = true;
+      continue;
+    }
+    if (arg == "--batch")
+    {
+      batch = true;
+      continue;
+    }
+    if (i + 1 == argc)
+    {
+      usage();
+      return 2;
+    }
+
+    std::string_view value = argv[++i];
+    bool ok = false;
+    if (arg == "--transactions")     ok = parse(value, w.transactions) && w.transactions;
+    else if (arg == "--ops")         ok = parse(value, w.opsPerTransaction);
+    else if (arg == "--concurrency") ok = parse(value, w.concurrency) && w.concurrency;
+    else if (arg == "--tables")      ok = parse(value, w.tables) && w.tables;
+    else if (arg == "--areas")       ok = parse(value, w.areas) && w.areas;
+    else if (arg == "--affinity")    ok = parse(value, w.affinity) && w.affinity >= 0.0;
+    else if (arg == "--shards")      ok = parse(value, w.shards);
+    else if (arg == "--writes")      ok = parse(value, w.writeRatio);
+    else if (arg == "--updates")     ok = parse(value, w.updateRatio);
+    else if (arg == "--zipf")        ok = parse(value, w.zipf) && w.zipf >= 0.0;
+    else if (arg == "--seed")        ok = parse(value, w.seed);
+    else if (arg == "--threads")     ok = parse(value, threads) && threads;
+    else if (arg == "--lexer")       ok = parse(value, lexerBytes) && lexerBytes;
+    else if (arg == "--granularity")
+    {
+      ok = true;
+      if (value == "row")        w.granularity = sgbd::Operation::Resource::Row;
+      else if (value == "page")  w.granularity = sgbd::Operation::Resource::Page;
+      else if (value == "table") w.granularity = sgbd::Operation::Resource::Table;
+      else if (value == "area")  w.granularity = sgbd::Operation::Resource::Area;
+      else ok = false;
+    }
+    else if (arg == "--routing")
+    {
+      ok = true;
+      if (value == "area")       w.routing = sgbd::ShardedScheduler::Routing::Area;
+      else if (value == "table") w.routing = sgbd::ShardedScheduler::Routing::Table;
+      else ok = false;
+    }
+    else if (arg == "--timestamps")
+    {
+      ok = true;
+      if (value == "counter")      w.timestamps = sgbd::TimestampOracle::Mode::Counter;
+      else if (value == "batched") w.timestamps = sgbd::TimestampOracle::Mode::Batched;
+      else if (value == "hybrid")  w.timestamps = sgbd::TimestampOracle::Mode::Hybrid;
+      else ok = false;
+    }
+
+    if (!ok)
+    {
+      std::cerr << "opção inválida: " << arg << ' ' << value << '\n';
+      usage();
+      return 2;
+    }
+  }
+
+  if (lexerBytes)
+  {
+    lexerBenchmark(lexerBytes, w.seed, json);
+    return 0;
+  }
+
+  // cada área precisa de pelo menos uma tabela
+  w.areas = std::min(w.areas, w.tables);
+  auto ops = generate(w);
+
+  std::vector<Result> results;
+  auto runAll = [&]<class Sched>()
+  {
+    for (auto n : { sgbd::usize(1), threads })
+    {
+      results.push_back(run<Sched>(w, ops, Policy::Detect,    "detect",     n));
+      results.push_back(run<Sched>(w, ops, Policy::WaitDie,   "wait-die",   n));
+      results.push_back(run<Sched>(w, ops, Policy::WoundWait, "wound-wait", n));
+      results.push_back(run<Sched>(w, ops, Policy::NoWait,    "no-wait",    n));
+      results.push_back(run<Sched>(w, ops, Policy::Periodic,  "periodic",   n));
+    }
+  };
+  if (w.shards)
+    runAll.operator()<sgbd::ShardedScheduler>();
+  else
+    runAll.operator()<sgbd::Scheduler>();
+
+  if (batch && !w.shards)
+  {
+    for (auto n : { sgbd::usize(1), threads })
+    {
+      results.push_back(run<sgbd::Scheduler>(w, ops, Policy::Detect,    "detect/batch",     n, true));
+      results.push_back(run<sgbd::Scheduler>(w, ops, Policy::WaitDie,   "wait-die/batch",   n, true));
+      results.push_back(run<sgbd::Scheduler>(w, ops, Policy::WoundWait, "wound-wait/batch", n, true));
+      results.push_back(run<sgbd::Scheduler>(w, ops, Policy::NoWait,    "no-wait/batch",    n, true));
+      results.push_back(run<sgbd::Scheduler>(w, ops, Policy::Periodic,  "periodic/batch",   n, true));
+    }
+  }
+
+  if (async)
+  {
+    results.push_back(runAsync(w, ops, Policy::Detect,    "detect/async"));
+    results.push_back(runAsync(w, ops, Policy::WaitDie,   "wait-die/async"));
+    results.push_back(runAsync(w, ops, Policy::WoundWait, "wound-wait/async"));
+    results.push_back(runAsync(w, ops, Policy::NoWait,    "no-wait/async"));
+    results.push_back(runAsync(w, ops, Policy::Periodic,  "periodic/async"));
+  }
+
+  if (json)
+    printJson(w, ops.size(), results);
+  else
+    printText(w, ops.size(), results);
+
+  bool ok = std::all_of(results.begin(), results.end(), [](const Result& r)
+  {
+    return r.serializable;
+  });
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,86 @@
+#include "serializability.hpp"
+
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+
+bool isSerializable(const std::vector<sgbd::Operation>& schedule)
+{
+  using Item = std::pair<const sgbd::Table*, sgbd::usize>;
+
+  std::unordered_map<sgbd::usize, sgbd::usize> commitAt;
+  for (sgbd::usize i = 0; i < schedule.size(); i++)
+    if (schedule[i].type.index() == sgbd::Operation::CommitI)
+      commitAt[schedule[i].tr->id] = i;
+
+  // versões de cada objeto na ordem dos commits: (posição do commit, escritor)
+  std::map<Item, std::vector<std::pair<sgbd::usize, sgbd::usize>>> versions;
+  for (auto& op : schedule)
+  {
+    auto commit = commitAt.find(op.tr->id);
+    if (commit != commitAt.end() && op.type.index() == sgbd::Operation::WriteI)
+      versions[{ std::get<sgbd::Operation::Write>(op.type).table, op.obj }]
+        .push_back({ commit->second, op.tr->id });
+  }
+  for (auto& [item, writers] : versions)
+  {
+    std::sort(writers.begin(), writers.end());
+    writers.erase(std::unique(writers.begin(), writers.end()), writers.end());
+  }
+
+  std::unordered_map<sgbd::usize, std::vector<sgbd::usize>> edges;
+  for (auto& [item, writers] : versions)
+    for (sgbd::usize i = 1; i < writers.size(); i++)
+      edges[writers[i - 1].second].push_back(writers[i].second);
+
+  for (sgbd::usize i = 0; i < schedule.size(); i++)
+  {
+    auto& op = schedule[i];
+    if (op.type.index() != sgbd::Operation::ReadI || !commitAt.contains(op.tr->id))
+      continue;
+
+    auto found = versions.find({ std::get<sgbd::Operation::Read>(op.type).table, op.obj });
+    if (found == versions.end())
+      continue;
+
+    auto& writers = found->second;
+    auto next = std::lower_bound(writers.begin(), writers.end(), std::pair { i, sgbd::usize(0) });
+    for (auto it = next; it != writers.begin();)
+      if ((--it)->second != op.tr->id)
+      {
+        edges[it->second].push_back(op.tr->id);
+        break;
+      }
+    for (auto it = next; it != writers.end(); ++it)
+      if (it->second != op.tr->id)
+      {
+        edges[op.tr->id].push_back(it->second);
+        break;
+      }
+  }
+
+  // Kahn: o grafo é acíclico se todos os nós saem
+  std::unordered_map<sgbd::usize, sgbd::usize> pending;
+  for (auto& [tr, at] : commitAt)
+    pending[tr];
+  for (auto& [tr, out] : edges)
+    for (auto next : out)
+      pending[next]++;
+
+  std::vector<sgbd::usize> ready;
+  for (auto& [tr, count] : pending)
+    if (!count)
+      ready.push_back(tr);
+
+  sgbd::usize visited = 0;
+  while (!ready.empty())
+  {
+    auto tr = ready.back();
+    ready.pop_back();
+    visited++;
+    for (auto next : edges[tr])
+      if (--pending[next] == 0)
+        ready.push_back(next);
+  }
+  return visited == pending.size();
+}
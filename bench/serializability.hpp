@@ -0,0 +1,15 @@
+#pragma once
+
+#include "transaction.hpp"
+
+#include <vector>
+
+/// @brief Verifica se as transações efetivadas do escalonamento são
+/// serializáveis sob 2V2PL: uma leitura vê a última versão efetivada antes
+/// dela e as versões de um objeto seguem a ordem dos commits. O grafo de
+/// serialização liga quem escreveu a versão lida ao leitor, o leitor a quem
+/// escreveu a versão seguinte e cada versão à seguinte.
+/// @param schedule Escalonamento emitido. Os objetos são identificados por
+/// (tabela, obj), então todas as operações devem usar a mesma granulosidade.
+/// @return true se o grafo não tem ciclos.
+bool isSerializable(const std::vector<sgbd::Operation>& schedule);
@@ -0,0 +1,120 @@
+#include "workload.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <string>
+
+/// @brief A, B, ..., Z e depois A26, A27, ...
+static auto areaName(sgbd::usize area) -> std::string
+{
+  return area < 26 ? std::string(1, char('A' + area)) : "A" + std::to_string(area);
+}
+
+void populateData(sgbd::ResourceManager& resManager, const Workload& w)
+{
+  for (sgbd::usize t = 0; t < w.tables; t++)
+  {
+    auto name = "t" + std::to_string(t);
+    auto table = resManager.createTable(name, areaName(t % w.areas));
+    table->reserve(w.pages * w.rowsPerPage, w.pages);
+
+    std::vector<sgbd::Table::Row> rows(w.rowsPerPage);
+    for (sgbd::usize p = 0, id = 0; p < w.pages; p++)
+    {
+      for (auto& row : rows)
+        row.id = id++;
+      table->insertRows(rows, p);
+    }
+  }
+}
+
+auto generate(const Workload& w) -> std::vector<GeneratedOp>
+{
+  std::mt19937 rng(w.seed);
+  std::uniform_real_distribution<double> coin(0.0, 1.0);
+  std::uniform_int_distribution<sgbd::usize> row(0, w.pages * w.rowsPerPage - 1);
+  std::uniform_int_distribution<sgbd::usize> page(0, w.pages - 1);
+
+  // tabela k (a partir de 0) tem peso 1 / (k + 1)^zipf
+  std::vector<double> cdf(w.tables);
+  double sum = 0.0;
+  for (sgbd::usize t = 0; t < w.tables; t++)
+    cdf[t] = sum += 1.0 / std::pow(double(t + 1), w.zipf);
+
+  auto table = [&]
+  {
+    auto it = std::lower_bound(cdf.begin(), cdf.end(), coin(rng) * sum);
+    return std::min<sgbd::usize>(it - cdf.begin(), w.tables - 1);
+  };
+
+  auto object = [&]
+  {
+    switch (w.granularity)
+    {
+      case sgbd::Operation::Resource::Row:  return row(rng);
+      case sgbd::Operation::Resource::Page: return page(rng);
+      default:                              return sgbd::npos;
+    }
+  };
+
+  struct Active { sgbd::usize trid, left; };
+  std::vector<Active> active;
+  std::vector<GeneratedOp> ops;
+  ops.reserve(w.transactions * (w.opsPerTransaction + 1));
+  sgbd::usize next = 1;
+
+  while (next <= w.transactions || !active.empty())
+  {
+    while (active.size() < w.concurrency && next <= w.transactions)
+      active.push_back({ next++, w.opsPerTransaction });
+
+    auto i = std::uniform_int_distribution<sgbd::usize>(0, active.size() - 1)(rng);
+    auto& tr = active[i];
+    if (tr.left == 0)
+    {
+      ops.push_back({ tr.trid, 3, 0, sgbd::npos });
+      active[i] = active.back();
+      active.pop_back();
+      continue;
+    }
+
+    auto p = coin(rng);
+    sgbd::ubyte kind = p < w.writeRatio ? 2 : (p < w.writeRatio + w.updateRatio ? 1 : 0);
+    auto t = table();
+    // só sorteia quando usada, para não mudar as cargas sem afinidade
+    if (w.affinity > 0.0 && coin(rng) < w.affinity)
+    {
+      auto home = tr.trid % w.areas;
+      t = t - t % w.areas + home;
+      if (t >= w.tables)
+        t = home;
+    }
+    ops.push_back({ tr.trid, kind, t, object() });
+    tr.left--;
+  }
+  return ops;
+}
+
+auto makeOperation(const GeneratedOp& g, const Workload& w,
+  sgbd::TransactionManager& trManager, const std::vector<sgbd::Table*>& tables) -> sgbd::Operation
+{
+  sgbd::Operation op { trManager.registerTransaction(g.trid), sgbd::Operation::Commit{},
+    w.granularity, g.obj };
+  switch (g.kind)
+  {
+    case 0: op.type = sgbd::Operation::Read { tables[g.table], false }; break;
+    case 1: op.type = sgbd::Operation::Read { tables[g.table], true };  break;
+    case 2: op.type = sgbd::Operation::Write { tables[g.table] };       break;
+    default: op.res = sgbd::Operation::Resource::Row;                   break;
+  }
+  return op;
+}
+
+auto tablesOf(sgbd::ResourceManager& resManager, const Workload& w) -> std::vector<sgbd::Table*>
+{
+  std::vector<sgbd::Table*> tables;
+  for (sgbd::usize t = 0; t < w.tables; t++)
+    tables.push_back(resManager.getTable("t" + std::to_string(t)));
+  return tables;
+}
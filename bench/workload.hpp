@@ -0,0 +1,49 @@
+#pragma once
+
+#include "sharded_scheduler.hpp"
+#include "table.hpp"
+#include "transaction.hpp"
+
+#include <vector>
+
+/// @brief Operação gerada, independente das transações de uma execução.
+struct GeneratedOp
+{
+  sgbd::usize trid;
+  sgbd::ubyte kind; // 0 = leitura, 1 = leitura com updl, 2 = escrita, 3 = commit
+  sgbd::usize table;
+  sgbd::usize obj;  // tupla, página ou npos conforme a granulosidade
+};
+
+/// @brief Parâmetros da carga sintética.
+struct Workload
+{
+  sgbd::usize tables = 8;
+  sgbd::usize areas = 2;     ///< Tabela t fica na área t % areas.
+  sgbd::usize pages = 4;
+  sgbd::usize rowsPerPage = 25;
+  sgbd::usize transactions = 2000;
+  sgbd::usize opsPerTransaction = 8;
+  sgbd::usize concurrency = 32;
+  double writeRatio = 0.2;
+  double updateRatio = 0.1;
+  double zipf = 0.0; ///< Expoente da distribuição das tabelas (0 = uniforme).
+  double affinity = 0.0; ///< Chance de uma operação ir para a área da transação (trid % areas).
+  sgbd::Operation::Resource granularity = sgbd::Operation::Resource::Row;
+  sgbd::TimestampOracle::Mode timestamps = sgbd::TimestampOracle::Mode::Counter;
+  sgbd::usize shards = 0; ///< 0 = um único Scheduler.
+  sgbd::ShardedScheduler::Routing routing = sgbd::ShardedScheduler::Routing::Area;
+  unsigned seed = 42;
+};
+
+void populateData(sgbd::ResourceManager& resManager, const Workload& w);
+
+/// @brief Intercala as operações de `concurrency` transações ativas. A tabela
+/// de cada operação segue uma distribuição de Zipf com expoente w.zipf e, com
+/// chance w.affinity, é trocada pela tabela equivalente da área da transação.
+auto generate(const Workload& w) -> std::vector<GeneratedOp>;
+
+auto makeOperation(const GeneratedOp& g, const Workload& w,
+  sgbd::TransactionManager& trManager, const std::vector<sgbd::Table*>& tables) -> sgbd::Operation;
+
+auto tablesOf(sgbd::ResourceManager& resManager, const Workload& w) -> std::vector<sgbd::Table*>;
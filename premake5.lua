@@ -14,3 +14,24 @@ workspace "2v2pl"
     objdir "build/obj/%{cfg.system}/%{prj.name}"
 
     files { "src/**.hpp", "src/**.cpp" }
+
+    filter "system:linux"
+      links { "pthread" }
+
+  project "bench"
+    kind "ConsoleApp"
+    language "C++"
+    cppdialect "C++20"
+    staticruntime "off"
+    optimize "Speed"
+    location ("build/projects/" .. _ACTION .. "/%{prj.name}")
+
+    targetdir "build/bin/%{cfg.system}/%{prj.name}"
+    objdir "build/obj/%{cfg.system}/%{prj.name}"
+
+    includedirs { "src" }
+    files { "src/**.hpp", "src/**.cpp", "bench/**.hpp", "bench/**.cpp" }
+    removefiles { "src/main.cpp" }
+
+    filter "system:linux"
+      links { "pthread" }
@@ -0,0 +1,159 @@
+#include "async_scheduler.hpp"
+
+#include <memory>
+
+namespace sgbd
+{
+
+/// @brief Conclusões da thread esperando o fim da chamada.
+static auto ready() -> std::vector<std::pair<AsyncScheduler::Callback, Outcome>>&
+{
+  thread_local std::vector<std::pair<AsyncScheduler::Callback, Outcome>> completions;
+  return completions;
+}
+
+bool AsyncScheduler::Awaitable::await_suspend(std::coroutine_handle<> handle)
+{
+  m_handle = handle;
+  m_scheduler.schedule(m_op, [this](Outcome outcome)
+  {
+    m_outcome = outcome;
+    if (m_state.exchange(Done) == Suspended)
+      m_handle.resume();
+  });
+
+  // completou dentro de schedule: segue sem suspender
+  return m_state.exchange(Suspended) != Done;
+}
+
+AsyncScheduler::AsyncScheduler(Scheduler& scheduler)
+  : m_scheduler(scheduler)
+{
+  m_scheduler.setOutput({
+    [this](const Operation& op) { onEmit(op); },
+    [this](const Transaction& tr) { onAbort(tr); },
+    {},
+  });
+}
+
+void AsyncScheduler::schedule(Operation op, Callback done)
+{
+  auto tr = op.tr;
+  if (tr->aborted || tr->committed)
+  {
+    complete(std::move(done), { Outcome::Rejected, tr->abortReason });
+    flush();
+    return;
+  }
+
+  // antes de escalonar: a operação pode ser emitida durante a chamada
+  m_inFlight++;
+  {
+    auto& bucket = bucketOf(tr);
+    std::lock_guard lock(bucket.mutex);
+    bucket.pending[tr].push_back(std::move(done));
+  }
+  m_scheduler.schedule(op);
+
+  // abortada antes de a operação chegar ao escalonador: ele a descartou e
+  // onAbort já passou; o que ainda estiver pendente nunca será emitido
+  if (tr->aborted)
+    fail(tr, { Outcome::Aborted, tr->abortReason });
+  flush();
+}
+
+auto AsyncScheduler::schedule(Operation op) -> std::future<Outcome>
+{
+  // std::function precisa ser copiável
+  auto promise = std::make_shared<std::promise<Outcome>>();
+  auto future = promise->get_future();
+  schedule(op, [promise](Outcome outcome) { promise->set_value(outcome); });
+  return future;
+}
+
+usize AsyncScheduler::detectDeadlocks()
+{
+  auto victims = m_scheduler.detectDeadlocks();
+  flush();
+  return victims;
+}
+
+usize AsyncScheduler::tick()
+{
+  auto victims = m_scheduler.tick();
+  flush();
+  return victims;
+}
+
+void AsyncScheduler::onEmit(const Operation& op)
+{
+  if (m_output.emit)
+    m_output.emit(op);
+
+  Callback done;
+  {
+    auto& bucket = bucketOf(op.tr);
+    std::lock_guard lock(bucket.mutex);
+    auto it = bucket.pending.find(op.tr);
+    if (it == bucket.pending.end())
+      return;
+
+    done = std::move(it->second.front());
+    it->second.pop_front();
+    if (it->second.empty())
+      bucket.pending.erase(it);
+  }
+  m_inFlight--;
+  complete(std::move(done), { Outcome::Emitted, AbortReason::None });
+}
+
+void AsyncScheduler::onAbort(const Transaction& tr)
+{
+  if (m_output.abort)
+    m_output.abort(tr);
+  fail(&tr, { Outcome::Aborted, tr.abortReason });
+}
+
+void AsyncScheduler::fail(const Transaction* tr, Outcome outcome)
+{
+  std::deque<Callback> pending;
+  {
+    auto& bucket = bucketOf(tr);
+    std::lock_guard lock(bucket.mutex);
+    auto it = bucket.pending.find(tr);
+    if (it == bucket.pending.end())
+      return;
+
+    pending = std::move(it->second);
+    bucket.pending.erase(it);
+  }
+
+  m_inFlight -= pending.size();
+  for (auto& done : pending)
+    complete(std::move(done), outcome);
+}
+
+void AsyncScheduler::complete(Callback&& done, Outcome outcome)
+{
+  ready().emplace_back(std::move(done), outcome);
+}
+
+void AsyncScheduler::flush()
+{
+  thread_local bool flushing = false;
+  if (flushing)
+    return;
+
+  // uma conclusão pode escalonar e completar outras, que entram no fim
+  flushing = true;
+  auto& completions = ready();
+  for (usize i = 0; i < completions.size(); i++)
+  {
+    auto [done, outcome] = std::move(completions[i]);
+    done(outcome);
+  }
+  completions.clear();
+  flushing = false;
+}
+
+} // namespace sgbd
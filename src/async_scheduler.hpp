@@ -0,0 +1,151 @@
+#pragma once
+
+#include "common.hpp"
+#include "scheduler.hpp"
+#include "transaction.hpp"
+
+#include <array>
+#include <atomic>
+#include <coroutine>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace sgbd
+{
+
+/// @brief Resultado de uma operação enviada ao AsyncScheduler.
+struct Outcome
+{
+  enum Status : ubyte
+  {
+    Emitted,  ///< Todos os bloqueios concedidos e a operação emitida.
+    Aborted,  ///< A transação foi abortada antes de a operação ser emitida.
+    Rejected, ///< A transação já tinha terminado quando a operação chegou.
+  };
+
+  Status status = Emitted;
+  AbortReason reason = AbortReason::None; ///< Com Aborted ou Rejected de uma abortada.
+
+  bool emitted() const { return status == Emitted; }
+};
+
+/// @brief Interface assíncrona sobre um Scheduler: cada operação completa
+/// quando é emitida ou quando a sua transação é abortada, por callback,
+/// std::future ou co_await.
+///
+/// O AsyncScheduler ocupa o Output do Scheduler e repassa as operações e os
+/// abortos para o Output dado em setOutput. As conclusões nunca rodam dentro
+/// do escalonador: ficam com a thread que causou a emissão (a que escalonou a
+/// operação ou a que liberou o bloqueio) e rodam no fim da sua chamada, então
+/// uma continuação pode escalonar de novo sem aprofundar a pilha. Com uma
+/// única thread todas as conclusões rodam nela, como num laço de eventos.
+///
+/// Todas as chamadas ao Scheduler devem passar pelo AsyncScheduler; uma
+/// chamada direta pode emitir operações cujas conclusões ficam paradas até a
+/// próxima chamada daquela thread.
+class AsyncScheduler
+{
+ public:
+  using Callback = std::function<void(Outcome)>;
+
+  /// @brief `co_await scheduler.submit(op)` escalona op e retorna o Outcome.
+  /// Não suspende se a operação completar durante o escalonamento; senão a
+  /// corrotina é retomada pela thread que completar a operação.
+  class Awaitable
+  {
+   public:
+    Awaitable(AsyncScheduler& scheduler, Operation op) : m_scheduler(scheduler), m_op(op) {}
+
+    bool await_ready() const noexcept { return false; }
+    bool await_suspend(std::coroutine_handle<> handle);
+    Outcome await_resume() const noexcept { return m_outcome; }
+
+   private:
+    enum State : ubyte { Pending, Suspended, Done };
+
+    AsyncScheduler& m_scheduler;
+    Operation m_op;
+    Outcome m_outcome;
+    std::coroutine_handle<> m_handle;
+    std::atomic<State> m_state = Pending;
+  };
+
+ public:
+  AsyncScheduler(Scheduler& scheduler);
+
+  AsyncScheduler(const AsyncScheduler&) = delete;
+  AsyncScheduler& operator=(const AsyncScheduler&) = delete;
+
+  /// @brief Destino das operações emitidas e dos abortos, chamado antes das
+  /// conclusões. Deve ser trocado sem threads escalonando.
+  void setOutput(Scheduler::Output output) { m_output = std::move(output); }
+
+  Scheduler& getScheduler() { return m_scheduler; }
+
+  /// @brief Operações escalonadas que ainda não completaram.
+  usize getInFlight() const { return m_inFlight; }
+
+  /// @brief Escalona op e chama done quando ela completar.
+  /// @param op
+  /// @param done
+  void schedule(Operation op, Callback done);
+
+  /// @brief Escalona op. O future só fica pronto quando alguma thread
+  /// escalonar a operação que libera o bloqueio; esperar por ele na única
+  /// thread que escalona nunca termina se a operação ficar em espera. Com
+  /// DeadlockPolicy::Periodic, um ciclo formado pela última operação só é
+  /// desfeito por tick, e.g. chamado por um DeadlockDetector.
+  /// @param op
+  auto schedule(Operation op) -> std::future<Outcome>;
+
+  /// @brief Awaitable que escalona op ao ser esperado.
+  /// @param op
+  auto submit(Operation op) -> Awaitable { return { *this, op }; }
+
+  /// @brief Scheduler::detectDeadlocks, completando as operações das
+  /// vítimas.
+  usize detectDeadlocks();
+
+  /// @brief Scheduler::tick, completando as operações das vítimas.
+  usize tick();
+
+ private:
+  static constexpr usize BucketCount = 64;
+
+  /// @brief Conclusões pendentes de cada transação, na ordem de envio; as
+  /// operações de uma transação são emitidas nessa mesma ordem.
+  struct alignas(64) Bucket
+  {
+    std::mutex mutex;
+    std::unordered_map<const Transaction*, std::deque<Callback>> pending;
+  };
+
+ private:
+  auto bucketOf(const Transaction* tr) -> Bucket& { return m_buckets[tr->slot % BucketCount]; }
+
+  void onEmit(const Operation& op);
+  void onAbort(const Transaction& tr);
+
+  /// @brief Completa todas as operações pendentes de tr com outcome.
+  void fail(const Transaction* tr, Outcome outcome);
+
+  /// @brief Guarda a conclusão para o fim da chamada atual.
+  static void complete(Callback&& done, Outcome outcome);
+
+  /// @brief Roda as conclusões guardadas pela thread. Não faz nada se já
+  /// estiver rodando mais abaixo na pilha: as novas entram no mesmo laço.
+  static void flush();
+
+ private:
+  Scheduler& m_scheduler;
+  Scheduler::Output m_output;
+  std::array<Bucket, BucketCount> m_buckets;
+  std::atomic<usize> m_inFlight = 0;
+};
+
+} // namespace sgbd
@@ -0,0 +1,213 @@
+#include "catalog.hpp"
+#include "varint.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <unordered_set>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#elif defined(__linux__)
+#include <unistd.h>
+#endif
+
+namespace sgbd
+{
+
+static auto trim(std::string_view text) -> std::string_view
+{
+  auto first = text.find_first_not_of(" \t\r");
+  if (first == std::string_view::npos)
+    return {};
+  return text.substr(first, text.find_last_not_of(" \t\r") - first + 1);
+}
+
+static auto parseNumber(std::string_view text) -> std::optional<usize>
+{
+  usize value;
+  auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+  if (ec != std::errc() || end != text.data() + text.size())
+    return {};
+  return value;
+}
+
+/// @brief `área,tabela,páginas,tuplas` de uma linha de texto.
+static auto parseLine(std::string_view line) -> std::optional<CatalogEntry>
+{
+  std::string_view fields[4];
+  for (usize i = 0; i < 4; i++)
+  {
+    auto comma = i < 3 ? line.find(',') : line.size();
+    if (comma == std::string_view::npos)
+      return {};
+    fields[i] = trim(line.substr(0, comma));
+    line.remove_prefix(std::min(comma + 1, line.size()));
+  }
+  if (!line.empty())
+    return {};
+
+  auto pages = parseNumber(fields[2]);
+  auto rows = parseNumber(fields[3]);
+  if (fields[0].empty() || fields[1].empty() || !pages || !rows)
+    return {};
+  return CatalogEntry { fields[0], fields[1], *pages, *rows };
+}
+
+/// @brief As tuplas da entrada cabem nos limites, sem overflow.
+static bool withinLimits(const CatalogEntry& entry)
+{
+  return entry.pages <= catalog::MaxPages && entry.rowsPerPage <= catalog::MaxRowsPerPage &&
+    entry.pages * entry.rowsPerPage <= catalog::MaxRows;
+}
+
+CatalogLoader::CatalogLoader(ResourceManager& rm)
+  : m_resManager(rm)
+{
+}
+
+bool CatalogLoader::isBinary(std::string_view src)
+{
+  return src.starts_with(catalog::Magic);
+}
+
+auto CatalogLoader::parse(std::string_view src, usize& invalid) -> std::vector<CatalogEntry>
+{
+  std::vector<CatalogEntry> entries;
+  invalid = 0;
+
+  if (isBinary(src))
+  {
+    usize at = catalog::Magic.size();
+    auto name = [&]() -> std::optional<std::string_view>
+    {
+      auto size = getVarint(src, at);
+      if (!size || !*size || *size > src.size() - at)
+        return {};
+      at += *size;
+      return src.substr(at - *size, *size);
+    };
+
+    while (at < src.size())
+    {
+      auto area = name();
+      auto table = area ? name() : std::nullopt;
+      auto pages = table ? getVarint(src, at) : std::nullopt;
+      auto rows = pages ? getVarint(src, at) : std::nullopt;
+
+      // registro truncado: nada depois dele pode ser lido
+      if (!rows)
+      {
+        invalid++;
+        break;
+      }
+      CatalogEntry entry { *area, *table, *pages, *rows };
+      if (withinLimits(entry))
+        entries.push_back(entry);
+      else
+        invalid++;
+    }
+    return entries;
+  }
+
+  // uma linha por tabela; contar antes evita realocar o vetor
+  entries.reserve(usize(std::count(src.begin(), src.end(), '\n')) + 1);
+  while (!src.empty())
+  {
+    auto end = src.find('\n');
+    auto line = trim(src.substr(0, end));
+    src.remove_prefix(end == std::string_view::npos ? src.size() : end + 1);
+
+    if (line.empty() || line.front() == '#')
+      continue;
+    if (auto entry = parseLine(line); entry && withinLimits(*entry))
+      entries.push_back(*entry);
+    else
+      invalid++;
+  }
+  return entries;
+}
+
+void CatalogLoader::write(std::ostream& out, const std::vector<CatalogEntry>& entries)
+{
+  std::string buffer(catalog::Magic);
+  for (auto& entry : entries)
+  {
+    putVarint(buffer, entry.area.size());
+    buffer += entry.area;
+    putVarint(buffer, entry.table.size());
+    buffer += entry.table;
+    putVarint(buffer, entry.pages);
+    putVarint(buffer, entry.rowsPerPage);
+  }
+  out.write(buffer.data(), std::streamsize(buffer.size()));
+}
+
+auto CatalogLoader::load(const std::vector<CatalogEntry>& entries) -> Stats
+{
+  Stats stats;
+
+  std::unordered_set<std::string_view> areas;
+  for (auto& entry : entries)
+    areas.insert(entry.area);
+  m_resManager.reserve(areas.size(), entries.size());
+  stats.areas = areas.size();
+
+  std::vector<Table::Row> rows;
+  for (auto& entry : entries)
+  {
+    // uma tabela repetida soma as entradas, e os limites valem para o total
+    if (auto existing = m_resManager.getTable(entry.table);
+        existing && (existing->pageCount() + entry.pages > catalog::MaxPages ||
+                     existing->rowCount() + entry.pages * entry.rowsPerPage > catalog::MaxRows))
+    {
+      stats.invalid++;
+      continue;
+    }
+
+    auto table = m_resManager.createTable(entry.table, entry.area);
+    auto first = table->rowCount();
+    auto firstPage = table->pageCount();
+    table->reserve(first + entry.pages * entry.rowsPerPage, firstPage + entry.pages);
+
+    // as páginas novas vêm depois das que a tabela já tinha
+    rows.resize(entry.rowsPerPage);
+    for (usize page = 0, id = first; page < entry.pages; page++)
+    {
+      for (auto& row : rows)
+        row.id = id++;
+      table->insertRows(rows, firstPage + page);
+    }
+
+    stats.tables++;
+    stats.rows += entry.pages * entry.rowsPerPage;
+  }
+
+  stats.residentBytes = residentMemory();
+  return stats;
+}
+
+usize residentMemory()
+{
+#ifdef _WIN32
+  PROCESS_MEMORY_COUNTERS counters;
+  if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    return counters.WorkingSetSize;
+  return 0;
+#elif defined(__linux__)
+  // segunda coluna: páginas residentes
+  std::ifstream statm("/proc/self/statm");
+  usize size, resident;
+  if (statm >> size >> resident)
+    return resident * usize(sysconf(_SC_PAGESIZE));
+  return 0;
+#else
+  return 0;
+#endif
+}
+
+} // namespace sgbd
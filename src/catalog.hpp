@@ -0,0 +1,92 @@
+#pragma once
+
+#include "common.hpp"
+#include "table.hpp"
+
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+namespace sgbd
+{
+
+/// @brief Formatos de catálogo.
+///
+/// Texto: uma tabela por linha, `área,tabela,páginas,tuplas por página`.
+/// Linhas vazias e começadas por `#` são ignoradas e os campos podem ter
+/// espaços em volta.
+///
+/// Binário: Magic seguido de um registro por tabela com o tamanho e os bytes
+/// da área, o tamanho e os bytes da tabela, as páginas e as tuplas por página,
+/// todos os números em varint (LEB128).
+namespace catalog
+{
+
+constexpr std::string_view Magic = "2v2c\x01";
+
+/// @brief Limites de uma tabela; entradas maiores, sozinhas ou somadas às
+/// anteriores da mesma tabela, são inválidas.
+constexpr usize MaxPages = usize(1) << 24;
+constexpr usize MaxRowsPerPage = usize(1) << 16;
+constexpr usize MaxRows = usize(1) << 30; ///< páginas * tuplas por página.
+
+} // namespace catalog
+
+/// @brief Uma tabela do catálogo. As tuplas recebem ids 0, 1, ... página a
+/// página, como em populateData.
+struct CatalogEntry
+{
+  std::string_view area;
+  std::string_view table;
+  usize pages;
+  usize rowsPerPage;
+};
+
+/// @brief Carrega um catálogo de áreas e tabelas no ResourceManager.
+///
+/// A leitura é feita direto do buffer (e.g. MappedFile::view) em duas etapas:
+/// parse separa as entradas sem copiar nomes e load dimensiona os mapas do
+/// ResourceManager e a coluna de cada tabela antes de inserir, então a carga
+/// não causa rehash nem realocação das tuplas.
+class CatalogLoader
+{
+ public:
+  struct Stats
+  {
+    usize areas = 0;
+    usize tables = 0;
+    usize rows = 0;
+    usize invalid = 0;       ///< Entradas que passariam dos limites na tabela já carregada.
+    usize residentBytes = 0; ///< Memória residente do processo depois da carga (0 se desconhecida).
+  };
+
+ public:
+  CatalogLoader(ResourceManager& rm);
+
+  /// @brief Verifica se src começa com o cabeçalho do formato binário.
+  static bool isBinary(std::string_view src);
+
+  /// @brief Separa as entradas de um catálogo em texto ou binário. Os nomes
+  /// apontam para src.
+  /// @param src
+  /// @param invalid Recebe a quantidade de linhas ou registros inválidos,
+  /// incluindo as entradas acima dos limites de catalog.
+  static auto parse(std::string_view src, usize& invalid) -> std::vector<CatalogEntry>;
+
+  /// @brief Escreve as entradas no formato binário.
+  static void write(std::ostream& out, const std::vector<CatalogEntry>& entries);
+
+  /// @brief Carrega as entradas no ResourceManager; tabelas já existentes
+  /// ganham as novas tuplas depois das que já tinham, desde que o total caiba
+  /// nos limites de catalog.
+  auto load(const std::vector<CatalogEntry>& entries) -> Stats;
+
+ private:
+  ResourceManager& m_resManager;
+};
+
+/// @brief Memória residente do processo em bytes ou 0 se a plataforma não
+/// informar.
+usize residentMemory();
+
+} // namespace sgbd
@@ -0,0 +1,35 @@
+#include "deadlock_detector.hpp"
+
+#include <algorithm>
+
+namespace sgbd
+{
+
+DeadlockDetector::DeadlockDetector(std::chrono::milliseconds interval, std::function<void()> tick)
+  : m_interval(std::max(interval, std::chrono::milliseconds(1))), m_tick(std::move(tick)),
+    m_thread(&DeadlockDetector::run, this)
+{
+}
+
+DeadlockDetector::~DeadlockDetector()
+{
+  {
+    std::lock_guard lock(m_mutex);
+    m_stopping = true;
+  }
+  m_stop.notify_one();
+  m_thread.join();
+}
+
+void DeadlockDetector::run()
+{
+  std::unique_lock lock(m_mutex);
+  while (!m_stop.wait_for(lock, m_interval, [this] { return m_stopping; }))
+  {
+    lock.unlock();
+    m_tick();
+    lock.lock();
+  }
+}
+
+} // namespace sgbd
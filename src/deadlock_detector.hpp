@@ -0,0 +1,43 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace sgbd
+{
+
+/// @brief Thread que chama tick a cada intervalo até ser destruída. Com
+/// DeadlockPolicy::Periodic os gatilhos de Scheduler::Detection só são
+/// conferidos quando alguém escalona; o detector os confere também quando as
+/// operações param de chegar, e.g. com [&] { scheduler.tick(); }.
+class DeadlockDetector
+{
+ public:
+  /// @param interval
+  /// @param tick Chamada na thread do detector; pode rodar junto com as
+  /// threads que escalonam.
+  DeadlockDetector(std::chrono::milliseconds interval, std::function<void()> tick);
+  ~DeadlockDetector();
+
+  DeadlockDetector(const DeadlockDetector&) = delete;
+  DeadlockDetector& operator=(const DeadlockDetector&) = delete;
+
+ private:
+  void run();
+
+ private:
+  std::chrono::milliseconds m_interval;
+  std::function<void()> m_tick;
+
+  std::mutex m_mutex;
+  std::condition_variable m_stop;
+  bool m_stopping = false;
+  std::thread m_thread;
+};
+
+} // namespace sgbd
@@ -3,65 +3,113 @@
 namespace sgbd
 {
 
-bool Lock::isCompatible(Type li, Type lj)
+// Matriz documentada, linhas = bloqueio pedido i, colunas = bloqueio
+// concedido j, na ordem de Lock::Type:
+//
+// |       | rl_j  | wl_j  | ul_j  | cl_j  | irl_j | iwl_j | iul_j | icl_j |
+// | rl_i  |   +   |   +   |   -   |   -   |   +   |   +   |   -   |   -   |
+// | wl_i  |   +   |   -   |   -   |   -   |   +   |   -   |   -   |   -   |
+// | ul_i  |   +   |   -   |   -   |   -   |   +   |   -   |   -   |   -   |
+// | cl_i  |   -   |   -   |   -   |   -   |   -   |   -   |   -   |   -   |
+// | irl_i |   +   |   +   |   -   |   -   |   +   |   +   |   +   |   -   |
+// | iwl_i |   +   |   -   |   -   |   -   |   +   |   +   |   +   |   -   |
+// | iul_i |   +   |   -   |   -   |   -   |   +   |   +   |   +   |   -   |
+// | icl_i |   -   |   -   |   -   |   -   |   -   |   -   |   -   |   -   |
+static constexpr const char* s_documentedMatrix[8] =
 {
-  switch (li)
+  "++--++--",
+  "+---+---",
+  "+---+---",
+  "--------",
+  "++--+++-",
+  "+---+++-",
+  "+---+++-",
+  "--------",
+};
+
+static constexpr bool matchesDocumentedMatrix(Lock::Type li)
+{
+  for (ubyte lj = 0; lj < 8; lj++)
+    if ((s_documentedMatrix[li][lj] == '+') != Lock::isCompatible(li, Lock::Type(lj)))
+      return false;
+  return true;
+}
+
+static_assert(matchesDocumentedMatrix(Lock::Read));
+static_assert(matchesDocumentedMatrix(Lock::Write));
+static_assert(matchesDocumentedMatrix(Lock::Update));
+static_assert(matchesDocumentedMatrix(Lock::Certify));
+static_assert(matchesDocumentedMatrix(Lock::IRead));
+static_assert(matchesDocumentedMatrix(Lock::IWrite));
+static_assert(matchesDocumentedMatrix(Lock::IUpdate));
+static_assert(matchesDocumentedMatrix(Lock::ICertify));
+
+// um update convive com as leituras já concedidas, mas uma leitura nova
+// espera o update (e o mesmo com IUpdate e as intenções de leitura)
+static_assert(Lock::isCompatible(Lock::Update, Lock::Read));
+static_assert(!Lock::isCompatible(Lock::Read, Lock::Update));
+static_assert(Lock::isCompatible(Lock::IUpdate, Lock::Read));
+static_assert(!Lock::isCompatible(Lock::Read, Lock::IUpdate));
+static_assert(Lock::isCompatible(Lock::IUpdate, Lock::IRead));
+static_assert(Lock::isCompatible(Lock::IRead, Lock::IUpdate));
+static_assert(!Lock::isCompatible(Lock::IRead, Lock::Update));
+
+/// @brief Força de um bloqueio de objeto, 0 para bloqueios de intenção.
+static int strength(Lock::Type type)
+{
+  switch (type)
   {
-    case Read:
-      switch (lj)
-      {
-        case Read:
-        case Write:
-        case Update:
-        case IRead:
-        case IWrite:
-        case IUpdate:
-          return true;
-      }
-      break;
-    case Write:
-      switch (lj)
-      {
-        case Read:
-        case IRead:
-          return true;
-      }
-      break;
-    case IRead:
-      switch (lj)
-      {
-        case Read:
-        case Write:
-        case Update:
-        case IRead:
-        case IWrite:
-        case IUpdate:
-          return true;
-      }
-      break;
-    case IWrite:
-      switch (lj)
-      {
-        case Read:
-        case IRead:
-        case IWrite:
-        case IUpdate:
-          return true;
-      }
-      break;
-    case IUpdate:
-      switch (lj)
-      {
-        case IRead:
-        case IWrite:
-        case IUpdate:
-          return true;
-      }
-      break;
+    case Lock::Read:    return 1;
+    case Lock::Update:  return 2;
+    case Lock::Write:   return 3;
+    case Lock::Certify: return 4;
+    default:            return 0;
   }
+}
+
+bool Lock::covers(Type held, Type requested)
+{
+  if (held == requested)
+    return true;
+
+  // uma intenção concedida já passou por todos os conflitos de uma IRead
+  // (a linha com mais compatíveis da matriz); IWrite e IUpdate não se cobrem
+  // porque a certificação converte só as IWrite
+  if (isIntent(held))
+    return requested == IRead;
+  return strength(held) >= strength(requested);
+}
+
+bool Lock::coversAny(ubyte held, Type requested)
+{
+  for (ubyte type = 0; type < 8; type++)
+    if ((held >> type) & 1 && covers(Type(type), requested))
+      return true;
   return false;
 }
 
+bool Lock::replaces(Type li, Type lj)
+{
+  if (!covers(li, lj))
+    return false;
+
+  // quem é compatível com li também precisa ser com lj
+  for (ubyte type = 0; type < 8; type++)
+    if (isCompatible(Type(type), li) && !isCompatible(Type(type), lj))
+      return false;
+  return true;
+}
+
+Lock::Type Lock::strongest(Type li, Type lj)
+{
+  return strength(li) >= strength(lj) ? li : lj;
+}
+
+bool Lock::isIntent(Type type)
+{
+  return type >= IRead;
+}
+
 Lock::Type Lock::readLock(bool isUpdate, bool isIntent)
 {
   return isUpdate ? (isIntent ? IUpdate : Update) : (isIntent ? IRead : Read);
@@ -78,17 +126,3 @@ Lock::Type Lock::certifyLock(bool isIntent)
 }
 
 } // namespace sgbd
-
-/*
-
-|       | rl_i  | wl_i  | ul_i  | cl_i  | irl_i | iwl_i | iul_i | icl_i |
-| rl_j  |   +   |   +   |   -   |   -   |   +   |   +   |   -   |   -   |
-| wl_j  |   +   |   -   |   -   |   -   |   +   |   -   |   -   |   -   |
-| ul_j  |   +   |   -   |   -   |   -   |   +   |   -   |   -   |   -   |
-| cl_j  |   -   |   -   |   -   |   -   |   -   |   -   |   -   |   -   |
-| irl_j |   +   |   +   |   -   |   -   |   +   |   +   |   +   |   -   |
-| iwl_j |   +   |   -   |   -   |   -   |   +   |   +   |   +   |   -   |
-| iul_j |   +   |   -   |   -   |   -   |   +   |   +   |   +   |   -   |
-| icl_j |   -   |   -   |   -   |   -   |   -   |   -   |   -   |   -   |
-
-*/
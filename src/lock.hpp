@@ -44,11 +44,64 @@ struct Lock
   Status status;
   Resource res;
 
+  /// @brief Matriz de compatibilidade: o bit lj de CompatMask[li] indica se
+  /// o bloqueio pedido li é compatível com o bloqueio concedido lj. Não é
+  /// simétrica: um Update convive com as leituras já concedidas e bloqueia
+  /// as novas.
+  static constexpr ubyte CompatMask[8] =
+  {
+    /* Read     */ 1 << Read | 1 << Write | 1 << IRead | 1 << IWrite,
+    /* Write    */ 1 << Read | 1 << IRead,
+    /* Update   */ 1 << Read | 1 << IRead,
+    /* Certify  */ 0,
+    /* IRead    */ 1 << Read | 1 << Write | 1 << IRead | 1 << IWrite | 1 << IUpdate,
+    /* IWrite   */ 1 << Read | 1 << IRead | 1 << IWrite | 1 << IUpdate,
+    /* IUpdate  */ 1 << Read | 1 << IRead | 1 << IWrite | 1 << IUpdate,
+    /* ICertify */ 0,
+  };
+
   /// @brief Verifica se os bloqueios li e lj são compativeis.
-  /// @param li Bloqueio i.
-  /// @param lj Bloqueio j.
+  /// @param li Bloqueio i (pedido).
+  /// @param lj Bloqueio j (concedido).
   /// @return true se compativeis.
-  static bool isCompatible(Type li, Type lj);
+  static constexpr bool isCompatible(Type li, Type lj)
+  {
+    return (CompatMask[li] >> lj) & 1;
+  }
+
+  /// @brief Verifica se o bloqueio li é compatível com todos os tipos do
+  /// grupo concedido (bit j ligado se algum bloqueio do tipo j foi concedido).
+  /// @param li Bloqueio i (pedido).
+  /// @param group Máscara dos tipos concedidos.
+  /// @return true se compativel com todo o grupo.
+  static constexpr bool isCompatibleWithGroup(Type li, ubyte group)
+  {
+    return (group & ~CompatMask[li]) == 0;
+  }
+
+  /// @brief Verifica se o bloqueio held já garante o acesso pedido por
+  /// requested no mesmo recurso (bloqueios de intenção só cobrem IRead).
+  /// @param held Bloqueio já concedido.
+  /// @param requested Bloqueio pedido.
+  /// @return true se held é igual ou mais forte que requested.
+  static bool covers(Type held, Type requested);
+
+  /// @brief Verifica se algum dos tipos da máscara cobre requested.
+  /// @param held Máscara com o bit i ligado para cada tipo i concedido.
+  /// @param requested Bloqueio pedido.
+  static bool coversAny(ubyte held, Type requested);
+
+  /// @brief Verifica se um bloqueio li pode ocupar o lugar de um lj da mesma
+  /// transação (e.g. Read -> Write): li cobre lj e conflita com tudo o que
+  /// conflita com lj.
+  /// @param li Bloqueio pedido.
+  /// @param lj Bloqueio concedido.
+  static bool replaces(Type li, Type lj);
+
+  /// @brief Retorna o mais forte entre dois bloqueios de objeto.
+  static Type strongest(Type li, Type lj);
+
+  static bool isIntent(Type type);
 
   static Type readLock(bool isUpdate, bool isIntent);
   static Type writeLock(bool isIntent);
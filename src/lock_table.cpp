@@ -0,0 +1,427 @@
+#include "lock_table.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <functional>
+#include <utility>
+
+namespace sgbd
+{
+
+/// @brief Primeiro bloqueio concedido de outra transação incompatível com o
+/// pedido.
+static Lock* findConflict(LockTable::Entry& entry, const Lock& lock)
+{
+  if (Lock::isCompatibleWithGroup(lock.type, entry.group))
+    return nullptr;
+
+  auto it = std::find_if(entry.holders.begin(), entry.holders.end(), [&](Lock& l)
+  {
+    return l.tr->id != lock.tr->id && !Lock::isCompatible(lock.type, l.type);
+  });
+  return it != entry.holders.end() ? &*it : nullptr;
+}
+
+/// @brief Bloqueio de outra transação que impede a concessão do pedido: um
+/// concedido incompatível, uma certificação em andamento ou um dos `ahead`
+/// primeiros da fila que conflita com o pedido. Quem já tem bloqueio no
+/// recurso só espera pelos concedidos, já que a fila pode esperar por ele.
+static Lock* findBlocker(LockTable::Entry& entry, const Lock& lock, usize ahead)
+{
+  if (auto conflict = findConflict(entry, lock))
+    return conflict;
+  if (!ahead && !entry.converting)
+    return nullptr;
+
+  bool holds = false;
+  Lock* certifier = nullptr;
+  for (auto& l : entry.holders)
+  {
+    if (l.tr->id == lock.tr->id)
+      holds = true;
+    else if (l.status == Lock::Converting && !certifier)
+      certifier = &l;
+  }
+  if (holds)
+    return nullptr;
+
+  // a certificação é incompatível com tudo: leitores novos não a adiam
+  if (certifier)
+    return certifier;
+
+  for (usize i = 0; i < ahead; i++)
+  {
+    auto& w = entry.waiters[i];
+    if (w.tr->id != lock.tr->id &&
+        (!Lock::isCompatible(lock.type, w.type) || !Lock::isCompatible(w.type, lock.type)))
+      return &w;
+  }
+  return nullptr;
+}
+
+usize LockTable::KeyHash::operator()(const Key& key) const
+{
+  usize h = std::hash<const void*>()(key.scope);
+  h ^= std::hash<usize>()(key.obj) + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+  h ^= usize(key.res) + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+  return h;
+}
+
+auto LockTable::keyOf(const Lock& lock) -> Key
+{
+  if (lock.res == Lock::Resource::Area)
+    return { lock.table->area, lock.res, npos };
+  if (lock.res == Lock::Resource::Table)
+    return { lock.table, lock.res, npos };
+  return { lock.table, lock.res, lock.obj };
+}
+
+Transaction* LockTable::acquire(const Lock& lock, bool wait)
+{
+  auto key = keyOf(lock);
+  auto& partition = partitionOf(key);
+  auto held = heldBy(lock.tr);
+  auto types = held ? held->find(key) : nullptr;
+  Transaction* blocker = nullptr;
+  {
+    std::lock_guard guard(partition.mutex);
+    auto found = partition.entries.find(key);
+    if (found == partition.entries.end())
+      found = partition.pool.insert(partition.entries, key, [](Entry& e) { e.reset(); });
+    auto& entry = found->second;
+
+    if (auto conflict = findBlocker(entry, lock, entry.waiters.size()))
+    {
+      blocker = conflict->tr;
+      if (!wait)
+        return blocker;
+    }
+
+    if (blocker)
+    {
+      entry.waiters.push_back(lock);
+      entry.waiters.back().status = Lock::Waiting;
+    }
+    else if (types && convert(entry, lock))
+    {
+      // ocupou o lugar de bloqueios mais fracos, que podem ter sido vários
+      *types = typesOf(entry, lock.tr);
+      return nullptr;
+    }
+    else
+    {
+      entry.holders.push_back(lock);
+      entry.holders.back().status = Lock::Granted;
+      entry.grant(lock.type);
+    }
+  }
+  m_size++;
+
+  // só a própria transação altera o seu índice
+  if (!types)
+  {
+    if (!held)
+    {
+      auto& shard = ownedShardOf(lock.tr);
+      std::lock_guard guard(shard.mutex);
+      held = &shard.pool.insert(shard.owned, lock.tr->id, [](Held& h)
+      {
+        h.keys.clear();
+        h.index.clear();
+      })->second;
+    }
+    held->keys.push_back(key);
+    types = &held->pool.insert(held->index, key, [](HeldTypes& t) { t = {}; })->second;
+  }
+  (blocker ? types->waiting : types->granted) |= ubyte(1 << lock.type);
+  return blocker;
+}
+
+bool LockTable::convert(Entry& entry, const Lock& lock)
+{
+  auto replaced = [&lock](const Lock& l)
+  {
+    return l.tr->id == lock.tr->id && l.status == Lock::Granted && Lock::replaces(lock.type, l.type);
+  };
+
+  auto isReader = [](Lock::Type type) { return type == Lock::Read || type == Lock::IRead; };
+
+  auto first = std::find_if(entry.holders.begin(), entry.holders.end(), replaced);
+  if (first == entry.holders.end())
+    return false;
+
+  bool readersLeft = isReader(first->type);
+  entry.revoke(first->type);
+  entry.grant(lock.type);
+  first->type = lock.type;
+
+  // os outros substituídos (e.g. IWrite e Read de uma tabela que passa a
+  // Write) deixam de existir
+  std::erase_if(entry.holders, [&](Lock& l)
+  {
+    if (&l == &*first || !replaced(l))
+      return false;
+    readersLeft |= isReader(l.type);
+    entry.revoke(l.type);
+    m_size--;
+    return true;
+  });
+  m_conversions++;
+
+  // um leitor a menos, como numa liberação: quem certifica confere de novo
+  if (readersLeft && !isReader(lock.type))
+  {
+    std::lock_guard guard(m_wokenMutex);
+    for (auto& l : entry.holders)
+      if (l.status == Lock::Converting)
+        m_woken.push_back(l.tr);
+  }
+  return true;
+}
+
+Transaction* LockTable::blockerOf(Transaction* tr)
+{
+  auto held = heldBy(tr);
+  if (!held)
+    return nullptr;
+
+  for (auto& key : held->keys)
+  {
+    // só os recursos com bloqueios em espera precisam ser conferidos
+    if (!held->find(key)->waiting)
+      continue;
+
+    auto& partition = partitionOf(key);
+    std::lock_guard lock(partition.mutex);
+
+    auto found = partition.entries.find(key);
+    if (found == partition.entries.end())
+      continue;
+
+    auto& entry = found->second;
+    for (usize i = 0; i < entry.waiters.size(); i++)
+      if (entry.waiters[i].tr->id == tr->id)
+        if (auto conflict = findBlocker(entry, entry.waiters[i], i))
+          return conflict->tr;
+  }
+  return nullptr;
+}
+
+bool LockTable::certify(Transaction* tr, std::vector<Transaction*>& readers)
+{
+  auto held = heldBy(tr);
+  if (!held)
+    return true;
+
+  constexpr ubyte writes = 1 << Lock::Write | 1 << Lock::IWrite;
+  constexpr ubyte reads = 1 << Lock::Read | 1 << Lock::IRead;
+
+  bool certified = true;
+  for (auto& key : held->keys)
+  {
+    auto& types = *held->find(key);
+    if (!((types.granted | types.converting) & writes))
+      continue;
+
+    auto& partition = partitionOf(key);
+    std::lock_guard lock(partition.mutex);
+    auto& entry = partition.entries.at(key);
+
+    // leitores do recurso menos os da própria transação (no máximo um de
+    // cada tipo, exceto pedidos repetidos); só com sobra os leitores são
+    // procurados, e podem não existir
+    uint own = std::popcount(ubyte(types.granted & reads));
+    bool hasReaders = entry.granted[Lock::Read] + entry.granted[Lock::IRead] > own;
+    if (hasReaders)
+    {
+      hasReaders = false;
+      for (auto& l : entry.holders)
+      {
+        if (l.tr->id != tr->id && (l.type == Lock::Read || l.type == Lock::IRead))
+        {
+          readers.push_back(l.tr);
+          hasReaders = true;
+        }
+      }
+    }
+
+    for (auto& l : entry.holders)
+    {
+      if (l.tr->id != tr->id || (l.type != Lock::Write && l.type != Lock::IWrite))
+        continue;
+
+      if (hasReaders)
+      {
+        if (l.status != Lock::Converting)
+          entry.converting++;
+        l.status = Lock::Converting;
+        certified = false;
+        continue;
+      }
+
+      if (l.status == Lock::Converting)
+        entry.converting--;
+      auto type = Lock::certifyLock(l.type == Lock::IWrite);
+      entry.revoke(l.type);
+      entry.grant(type);
+      l.type = type;
+      l.status = Lock::Granted;
+    }
+    types = typesOf(entry, tr);
+  }
+  return certified;
+}
+
+bool LockTable::covers(const Lock& lock)
+{
+  auto held = heldBy(lock.tr);
+  if (!held)
+    return false;
+
+  auto key = keyOf(lock);
+  auto types = held->find(key);
+  if (!types)
+    return false;
+
+  if (Lock::coversAny(types->granted, lock.type))
+    return true;
+  return
+    Lock::coversAny(types->waiting, lock.type) &&
+    Lock::coversAny(grantedOf(lock.tr, key, *types), lock.type);
+}
+
+bool LockTable::holds(Transaction* tr, const Key& key)
+{
+  auto held = heldBy(tr);
+  return held && held->find(key);
+}
+
+ubyte LockTable::grantedTypes(Transaction* tr, const Key& key)
+{
+  auto held = heldBy(tr);
+  if (!held)
+    return 0;
+
+  auto types = held->find(key);
+  if (!types)
+    return 0;
+  return types->waiting ? grantedOf(tr, key, *types) : types->granted;
+}
+
+bool LockTable::isWaiting(Transaction* tr)
+{
+  auto held = heldBy(tr);
+  if (!held)
+    return false;
+
+  for (auto& key : held->keys)
+  {
+    auto types = held->find(key);
+    if (!types->waiting)
+      continue;
+
+    grantedOf(tr, key, *types);
+    if (types->waiting)
+      return true;
+  }
+  return false;
+}
+
+void LockTable::release(Transaction* tr)
+{
+  releaseIf(tr, [](Lock&) { return true; });
+}
+
+void LockTable::takeWoken(std::vector<Transaction*>& woken)
+{
+  std::lock_guard lock(m_wokenMutex);
+  woken.swap(m_woken);
+}
+
+auto LockTable::snapshot() -> std::vector<Lock>
+{
+  std::vector<Lock> locks;
+  locks.reserve(m_size);
+  for (auto& partition : m_partitions)
+  {
+    std::lock_guard lock(partition.mutex);
+    for (auto& [key, entry] : partition.entries)
+    {
+      locks.insert(locks.end(), entry.holders.begin(), entry.holders.end());
+      locks.insert(locks.end(), entry.waiters.begin(), entry.waiters.end());
+    }
+  }
+
+  std::stable_sort(locks.begin(), locks.end(), [](const Lock& a, const Lock& b)
+  {
+    return a.tr->id < b.tr->id;
+  });
+  return locks;
+}
+
+auto LockTable::partitionOf(const Key& key) -> Partition&
+{
+  return m_partitions[KeyHash()(key) % PartitionCount];
+}
+
+auto LockTable::heldBy(Transaction* tr) -> Held*
+{
+  // referências a elementos de unordered_map sobrevivem a inserções
+  auto& shard = ownedShardOf(tr);
+  std::lock_guard lock(shard.mutex);
+  auto it = shard.owned.find(tr->id);
+  return it != shard.owned.end() ? &it->second : nullptr;
+}
+
+auto LockTable::grantedOf(Transaction* tr, const Key& key, HeldTypes& types) -> ubyte
+{
+  auto& partition = partitionOf(key);
+  std::lock_guard guard(partition.mutex);
+  if (auto found = partition.entries.find(key); found != partition.entries.end())
+    types = typesOf(found->second, tr);
+  return types.granted;
+}
+
+auto LockTable::typesOf(const Entry& entry, Transaction* tr) -> HeldTypes
+{
+  HeldTypes types;
+  for (auto* queue : { &entry.holders, &entry.waiters })
+    for (auto& l : *queue)
+      if (l.tr->id == tr->id)
+        types.add(l);
+  return types;
+}
+
+void LockTable::grantWaiters(Entry& entry, bool readersLeft)
+{
+  if (entry.waiters.empty() && !readersLeft)
+    return;
+
+  std::lock_guard lock(m_wokenMutex);
+
+  // mesma regra de um pedido novo, em ordem de chegada: os que continuam na
+  // fila ficam à frente dos seguintes, então um pedido incompatível com eles
+  // não passa na frente
+  usize kept = 0;
+  for (auto& waiter : entry.waiters)
+  {
+    m_woken.push_back(waiter.tr);
+    if (findBlocker(entry, waiter, kept))
+    {
+      entry.waiters[kept++] = waiter;
+      continue;
+    }
+
+    waiter.status = Lock::Granted;
+    entry.holders.push_back(waiter);
+    entry.grant(waiter.type);
+  }
+  entry.waiters.resize(kept);
+
+  if (readersLeft)
+    for (auto& l : entry.holders)
+      if (l.status == Lock::Converting)
+        m_woken.push_back(l.tr);
+}
+
+} // namespace sgbd
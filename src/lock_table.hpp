@@ -0,0 +1,385 @@
+#pragma once
+
+#include "common.hpp"
+#include "lock.hpp"
+#include "node_pool.hpp"
+#include "table.hpp"
+#include "transaction.hpp"
+
+#include <unordered_map>
+#include <vector>
+#include <array>
+#include <atomic>
+#include <mutex>
+
+namespace sgbd
+{
+
+/// @brief Tabela de bloqueios particionada por hash do recurso.
+///
+/// Cada recurso (tabela, granulosidade, objeto) possui sua própria fila de
+/// bloqueios concedidos e de espera, de modo que verificar conflitos,
+/// conceder e liberar custa O(bloqueios no recurso).
+///
+/// Cada partição tem o seu próprio mutex, então threads que bloqueiam recursos
+/// de partições diferentes não disputam entre si. Os bloqueios de uma
+/// transação só podem ser alterados por quem detém Transaction::mutex.
+///
+/// Cada transação tem também um índice dos recursos em que possui bloqueios,
+/// com os tipos de cada um, que responde sem travar a partição se um pedido
+/// já está coberto. Um pedido mais forte que um bloqueio já concedido à
+/// transação (Lock::replaces, e.g. Read -> Write) converte o bloqueio no
+/// lugar em vez de criar outro.
+class LockTable
+{
+ public:
+  /// @brief Identifica um recurso bloqueável.
+  /// Bloqueios de área usam a área da tabela como escopo.
+  struct Key
+  {
+    const void* scope;
+    Lock::Resource res;
+    usize obj;
+
+    bool operator==(const Key&) const = default;
+  };
+
+  struct KeyHash
+  {
+    usize operator()(const Key& key) const;
+  };
+
+  /// @brief Bloqueios de um único recurso.
+  struct Entry
+  {
+    std::vector<Lock> holders;
+    std::vector<Lock> waiters;
+
+    /// Resumo do grupo concedido: quantidade de bloqueios por tipo e máscara
+    /// com os tipos presentes, testada contra Lock::CompatMask.
+    std::array<uint, 8> granted {};
+    ubyte group = 0;
+
+    /// Bloqueios concedidos em Lock::Converting, que a fila não ultrapassa.
+    uint converting = 0;
+
+    void grant(Lock::Type type)
+    {
+      granted[type]++;
+      group |= ubyte(1 << type);
+    }
+
+    void revoke(Lock::Type type)
+    {
+      if (--granted[type] == 0)
+        group &= ubyte(~(1 << type));
+    }
+
+    /// @brief Esvazia a entrada mantendo a capacidade das filas.
+    void reset()
+    {
+      holders.clear();
+      waiters.clear();
+      granted = {};
+      group = 0;
+      converting = 0;
+    }
+  };
+
+ public:
+  /// @brief Calcula a chave do recurso protegido pelo bloqueio.
+  static Key keyOf(const Lock& lock);
+
+  /// @brief Concede o bloqueio se for compatível com os concedidos de outras
+  /// transações, com as certificações em andamento e com os pedidos que já
+  /// esperam no recurso; caso contrário o coloca no fim da fila. Uma
+  /// transação que já tem bloqueio no recurso só espera pelos concedidos. A
+  /// verificação e a inserção são atômicas em relação às liberações do
+  /// recurso.
+  /// @param lock Bloqueio pedido.
+  /// @param wait false para não inserir o bloqueio quando houver conflito.
+  /// @return Transação dona do primeiro bloqueio conflitante ou nullptr se o
+  /// bloqueio foi concedido.
+  Transaction* acquire(const Lock& lock, bool wait = true);
+
+  /// @brief Transação que impede a concessão do bloqueio em espera da
+  /// transação.
+  /// @param tr
+  /// @return Dona do primeiro bloqueio conflitante ou nullptr se tr não espera.
+  Transaction* blockerOf(Transaction* tr);
+
+  /// @brief Converte os bloqueios de escrita da transação em certificação.
+  /// Os que ainda têm leitores de outras transações ficam em conversão. Só
+  /// visita os recursos escritos pela transação, e a contagem de leitores de
+  /// cada recurso decide sem percorrer os outros bloqueios se a conversão é
+  /// possível.
+  /// @param tr
+  /// @param readers Recebe as transações leitoras que impedem a conversão.
+  /// @return true se todos os bloqueios foram convertidos.
+  bool certify(Transaction* tr, std::vector<Transaction*>& readers);
+
+  /// @brief Verifica se a transação do bloqueio já possui, no mesmo recurso,
+  /// um bloqueio concedido que o cobre.
+  /// @param lock Bloqueio pedido.
+  bool covers(const Lock& lock);
+
+  /// @brief Verifica se a transação possui algum bloqueio no recurso, em
+  /// qualquer estado.
+  /// @param tr
+  /// @param key
+  bool holds(Transaction* tr, const Key& key);
+
+  /// @brief Tipos dos bloqueios concedidos à transação no recurso.
+  /// @param tr
+  /// @param key
+  /// @return Máscara com o bit i ligado se há um bloqueio concedido do tipo i.
+  ubyte grantedTypes(Transaction* tr, const Key& key);
+
+  /// @brief Verifica se a transação possui algum bloqueio em espera.
+  /// @param tr
+  bool isWaiting(Transaction* tr);
+
+  /// @brief Remove todos os bloqueios da transação.
+  /// @param tr
+  void release(Transaction* tr);
+
+  /// @brief Remove os bloqueios da transação que satisfazem o predicado e
+  /// concede, em ordem de chegada, os bloqueios em espera que se tornaram
+  /// compatíveis nos recursos liberados (ver takeWoken).
+  /// @param tr
+  /// @param pred
+  template <class Pred>
+  void releaseIf(Transaction* tr, Pred&& pred);
+
+  /// @brief Visita todos os bloqueios da transação com a partição do recurso
+  /// travada; fn não pode chamar a tabela de bloqueios.
+  /// @param tr
+  /// @param fn
+  template <class Fn>
+  void forEach(Transaction* tr, Fn&& fn);
+
+  /// @brief Troca por `woken` (que deve estar vazio) as transações afetadas
+  /// pelas liberações: as que tiveram um bloqueio concedido, as que continuam
+  /// esperando em um recurso liberado e as que certificam e perderam algum
+  /// leitor. A troca mantém a capacidade dos dois vetores.
+  void takeWoken(std::vector<Transaction*>& woken);
+
+  /// @brief Cópia de todos os bloqueios para depuração.
+  auto snapshot() -> std::vector<Lock>;
+
+  usize size() const { return m_size; }
+
+  /// @brief Pedidos atendidos convertendo um bloqueio já concedido.
+  usize conversions() const { return m_conversions; }
+
+ private:
+  static constexpr usize PartitionCount = 64;
+
+  static constexpr usize OwnedShardCount = 64;
+
+  using Entries = std::unordered_map<Key, Entry, KeyHash>;
+
+  /// @brief Tipos dos bloqueios de uma transação em um recurso, por estado.
+  /// Só o dono altera; um bloqueio em espera concedido por outra thread
+  /// continua em waiting até ser conferido na partição.
+  struct HeldTypes
+  {
+    ubyte granted = 0;
+    ubyte waiting = 0;
+    ubyte converting = 0;
+
+    void add(const Lock& l)
+    {
+      switch (l.status)
+      {
+        case Lock::Granted:    granted |= ubyte(1 << l.type); break;
+        case Lock::Waiting:    waiting |= ubyte(1 << l.type); break;
+        case Lock::Converting: converting |= ubyte(1 << l.type); break;
+      }
+    }
+  };
+
+  using HeldIndex = std::unordered_map<Key, HeldTypes, KeyHash>;
+
+  /// @brief Recursos em que uma transação possui bloqueios, na ordem do
+  /// primeiro pedido e indexados pela chave.
+  struct Held
+  {
+    std::vector<Key> keys;
+    HeldIndex index;
+    NodePool<HeldIndex> pool {64};
+
+    auto find(const Key& key) -> HeldTypes*
+    {
+      auto it = index.find(key);
+      return it != index.end() ? &it->second : nullptr;
+    }
+
+    void forget(const Key& key)
+    {
+      if (auto it = index.find(key); it != index.end())
+        pool.erase(index, it);
+    }
+  };
+
+  using Owned = std::unordered_map<usize, Held>;
+
+  struct alignas(64) OwnedShard
+  {
+    std::mutex mutex;
+    Owned owned;
+    NodePool<Owned> pool;
+  };
+
+  // entradas e listas de recursos vazias voltam para os pools, então pedir e
+  // liberar bloqueios em regime não aloca
+  struct alignas(64) Partition
+  {
+    std::mutex mutex;
+    Entries entries;
+    NodePool<Entries> pool {256};
+  };
+
+  auto partitionOf(const Key& key) -> Partition&;
+
+  auto ownedShardOf(Transaction* tr) -> OwnedShard& { return m_owned[tr->id % OwnedShardCount]; }
+
+  /// @brief Recursos em que a transação possui bloqueios (nullptr se nenhum).
+  auto heldBy(Transaction* tr) -> Held*;
+
+  /// @brief Tipos da transação no recurso, conferindo na partição os que
+  /// estavam em espera.
+  /// @param types Entrada do índice da transação.
+  auto grantedOf(Transaction* tr, const Key& key, HeldTypes& types) -> ubyte;
+
+  /// @brief Tipos de todos os bloqueios da transação no recurso. Requer a
+  /// partição travada.
+  static auto typesOf(const Entry& entry, Transaction* tr) -> HeldTypes;
+
+  /// @brief Converte no lugar os bloqueios concedidos da transação que o
+  /// pedido substitui (Lock::replaces). Requer a partição travada e o pedido
+  /// compatível com os outros concedidos.
+  /// @return false se nenhum bloqueio da transação pode ser substituído.
+  bool convert(Entry& entry, const Lock& lock);
+
+  /// @brief Concede, na ordem da fila, os bloqueios em espera do recurso que
+  /// são compatíveis com os concedidos e com os que continuam à frente na
+  /// fila. Requer a partição travada.
+  /// @param entry
+  /// @param readersLeft true se algum bloqueio de leitura foi liberado.
+  void grantWaiters(Entry& entry, bool readersLeft);
+
+ private:
+  std::array<Partition, PartitionCount> m_partitions;
+
+  std::array<OwnedShard, OwnedShardCount> m_owned;
+
+  std::mutex m_wokenMutex;
+  std::vector<Transaction*> m_woken;
+
+  std::atomic<usize> m_size = 0;
+  std::atomic<usize> m_conversions = 0;
+};
+
+template <class Pred>
+void LockTable::releaseIf(Transaction* tr, Pred&& pred)
+{
+  auto held = heldBy(tr);
+  if (!held)
+    return;
+
+  auto& keys = held->keys;
+  for (auto it = keys.begin(); it != keys.end();)
+  {
+    auto& partition = partitionOf(*it);
+    std::lock_guard lock(partition.mutex);
+
+    auto found = partition.entries.find(*it);
+    if (found == partition.entries.end())
+    {
+      held->forget(*it);
+      it = keys.erase(it);
+      continue;
+    }
+
+    auto& entry = found->second;
+    HeldTypes left;
+    bool owns = false, released = false, dequeued = false, readersLeft = false;
+    for (auto* queue : { &entry.holders, &entry.waiters })
+    {
+      std::erase_if(*queue, [&](Lock& l)
+      {
+        if (l.tr->id != tr->id)
+          return false;
+        if (pred(l))
+        {
+          if (l.status == Lock::Converting)
+            entry.converting--;
+          if (l.status != Lock::Waiting)
+          {
+            entry.revoke(l.type);
+            released = true;
+            readersLeft |= l.type == Lock::Read || l.type == Lock::IRead;
+          }
+          else dequeued = true;
+          m_size--;
+          return true;
+        }
+        owns = true;
+        left.add(l);
+        return false;
+      });
+    }
+
+    // um pedido que sai da fila pode ser o que segurava os seguintes
+    if (released || dequeued)
+      grantWaiters(entry, readersLeft);
+
+    if (entry.holders.empty() && entry.waiters.empty())
+      partition.pool.erase(partition.entries, found);
+
+    if (owns)
+    {
+      *held->find(*it) = left;
+      ++it;
+    }
+    else
+    {
+      held->forget(*it);
+      it = keys.erase(it);
+    }
+  }
+
+  if (keys.empty())
+  {
+    auto& shard = ownedShardOf(tr);
+    std::lock_guard lock(shard.mutex);
+    if (auto found = shard.owned.find(tr->id); found != shard.owned.end())
+      shard.pool.erase(shard.owned, found);
+  }
+}
+
+template <class Fn>
+void LockTable::forEach(Transaction* tr, Fn&& fn)
+{
+  auto held = heldBy(tr);
+  if (!held)
+    return;
+
+  for (auto& key : held->keys)
+  {
+    auto& partition = partitionOf(key);
+    std::lock_guard lock(partition.mutex);
+
+    auto found = partition.entries.find(key);
+    if (found == partition.entries.end())
+      continue;
+
+    for (auto* queue : { &found->second.holders, &found->second.waiters })
+      for (auto& l : *queue)
+        if (l.tr->id == tr->id)
+          fn(l);
+  }
+}
+
+} // namespace sgbd
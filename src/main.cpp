@@ -2,10 +2,17 @@
 #include "parser.hpp"
 #include "table.hpp"
 #include "transaction.hpp"
+#include "operation_log.hpp"
 #include "operation_parser.hpp"
+#include "trace.hpp"
+#include "catalog.hpp"
 
+#include <chrono>
+#include <fstream>
 #include <iostream>
 #include <iomanip>
+#include <optional>
+#include <sstream>
 #include <string>
 
 void populateData(sgbd::ResourceManager& resManager, int pagec, int rowc)
@@ -20,22 +27,24 @@ void populateData(sgbd::ResourceManager& resManager, int pagec, int rowc)
       resManager.insertRow(tab, { (sgbd::usize)id }, p);
 }
 
-void showOperation(const sgbd::Operation& op)
+void showOperation(const sgbd::Operation& op, std::ostream& out = std::cout)
 {
-  std::cout << op.tr->id << " - ";
+  out << op.tr->id << " - ";
   switch (op.type.index())
   {
     case 0:
-      std::cout << "r: " << std::get<0>(op.type).table->name;
+      out << "r: " << std::get<0>(op.type).table->name;
       break;
     case 1:
-      std::cout << "w: " << std::get<1>(op.type).table->name;
+      out << "w: " << std::get<1>(op.type).table->name;
       break;
     case 2:
-      std::cout << 'c';
+      out << 'c';
       break;
   }
-  std::cout << '\n';
+  if (op.obj != sgbd::npos)
+    out << ':' << op.obj;
+  out << '\n';
 }
 
 std::string_view showLockType(sgbd::Lock::Type type)
@@ -79,46 +88,285 @@ std::string_view showLockRes(sgbd::Lock::Resource res)
 
 void showLock(const sgbd::Lock& l)
 {
+  auto obj = l.res == sgbd::Lock::Resource::Area ? l.table->area->id : l.table->name;
+  if (l.obj != sgbd::npos)
+    obj += ':' + std::to_string(l.obj);
+
   std::cout << " | "
     << std::setw(4)  << l.tr->id                 << " | "
-    << std::setw(10) << l.table->name            << " | "
+    << std::setw(10) << obj                      << " | "
     << std::setw(4)  << showLockType(l.type)     << " | "
     << std::setw(10) << showLockStatus(l.status) << " | "
     << std::setw(5)  << showLockRes(l.res)       << " |\n";
 }
 
+std::string_view showDeadlockPolicy(sgbd::Scheduler::DeadlockPolicy policy)
+{
+  switch (policy)
+  {
+    case sgbd::Scheduler::DeadlockPolicy::Detect:    return "detect";
+    case sgbd::Scheduler::DeadlockPolicy::WaitDie:   return "wait-die";
+    case sgbd::Scheduler::DeadlockPolicy::WoundWait: return "wound-wait";
+    case sgbd::Scheduler::DeadlockPolicy::NoWait:    return "no-wait";
+    case sgbd::Scheduler::DeadlockPolicy::Periodic:  return "periodic";
+  }
+  return "?";
+}
+
+auto parseDeadlockPolicy(std::string_view name) -> std::optional<sgbd::Scheduler::DeadlockPolicy>
+{
+  using Policy = sgbd::Scheduler::DeadlockPolicy;
+  for (auto policy : { Policy::Detect, Policy::WaitDie, Policy::WoundWait, Policy::NoWait,
+                       Policy::Periodic })
+    if (showDeadlockPolicy(policy) == name)
+      return policy;
+  return {};
+}
+
+void showStats(const sgbd::Scheduler& scheduler)
+{
+  auto& stats = scheduler.getStats();
+  auto& escalation = scheduler.getEscalation();
+  std::cout
+    << "política de deadlock:      " << showDeadlockPolicy(scheduler.getDeadlockPolicy()) << '\n'
+    << "abortos:                   " << stats.aborts              << '\n'
+    << "deadlocks detectados:      " << stats.deadlocks           << '\n'
+    << "transações feridas:        " << stats.wounds              << '\n'
+    << "detecções periódicas:      " << stats.detectionRuns       << '\n'
+    << "operações emitidas:        " << stats.emitted             << '\n'
+    << "transações devolvidas:     " << stats.retired             << '\n'
+    << "histórico guardado:        " << (scheduler.getRetention()
+                                         ? std::to_string(scheduler.getRetention()) : "tudo") << '\n'
+    << "bloqueios ativos:          " << scheduler.getLockCount()  << '\n'
+    << "limite por página:         " << escalation.pageThreshold  << '\n'
+    << "limite por tabela:         " << escalation.tableThreshold << '\n'
+    << "escalonamentos p/ página:  " << stats.pageEscalations     << '\n'
+    << "escalonamentos p/ tabela:  " << stats.tableEscalations    << '\n'
+    << "escalonamentos recusados:  " << stats.failedEscalations   << '\n'
+    << "bloqueios agrupados:       " << stats.foldedLocks         << '\n';
+}
+
 void showWaitForGraph(const sgbd::WaitForGraph& graph)
 {
-  for (auto& n : graph.getNodes())
+  graph.forEach([](sgbd::usize tr, const std::vector<sgbd::usize>& waitsFor)
   {
-    if (n.second.empty())
-      continue;
+    if (waitsFor.empty())
+      return;
 
-    std::cout << n.first << " -> ";
-    for (auto& t : n.second)
+    std::cout << tr << " -> ";
+    for (auto t : waitsFor)
       std::cout << t << " ";
     std::cout << '\n';
+  });
+}
+
+/// @brief Carrega o catálogo no lugar de populateData e mostra o tempo e a
+/// memória residente da carga.
+bool loadCatalog(sgbd::ResourceManager& resManager, const std::string& path,
+  const std::string& savePath)
+{
+  sgbd::MappedFile file;
+  if (!file.open(path))
+  {
+    std::cerr << "não foi possível abrir o catálogo: " << path << '\n';
+    return false;
+  }
+
+  sgbd::usize invalid;
+  auto start = std::chrono::steady_clock::now();
+  auto entries = sgbd::CatalogLoader::parse(file.view(), invalid);
+  auto stats = sgbd::CatalogLoader(resManager).load(entries);
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  std::cerr
+    << "catálogo:  " << stats.areas << " áreas, " << stats.tables << " tabelas, "
+    << stats.rows << " tuplas, " << invalid + stats.invalid << " inválidas\n"
+    << "carga:     " << elapsed.count() << " s, "
+    << std::fixed << std::setprecision(1) << stats.residentBytes / 1048576.0
+    << std::defaultfloat << std::setprecision(6) << " MB residentes\n";
+
+  if (!savePath.empty())
+  {
+    std::ofstream out(savePath, std::ios::binary);
+    sgbd::CatalogLoader::write(out, entries);
+    if (!out)
+    {
+      std::cerr << "não foi possível gravar o catálogo: " << savePath << '\n';
+      return false;
+    }
   }
+  return true;
 }
 
-int main()
+/// @brief Modo não interativo: reproduz um arquivo de trace e escreve o
+/// escalonamento e os abortos à medida que acontecem.
+int replayTrace(int argc, char** argv)
 {
+  std::string tracePath, outPath, abortsPath, recordPath, catalogPath, saveCatalogPath;
+  bool binary = false;
+  auto policy = sgbd::Scheduler::DeadlockPolicy::Detect;
+
+  for (int i = 1; i < argc; i++)
+  {
+    std::string_view arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--trace" && hasValue)       tracePath = argv[++i];
+    else if (arg == "--out" && hasValue)    outPath = argv[++i];
+    else if (arg == "--aborts" && hasValue) abortsPath = argv[++i];
+    else if (arg == "--record" && hasValue) recordPath = argv[++i];
+    else if (arg == "--catalog" && hasValue) catalogPath = argv[++i];
+    else if (arg == "--save-catalog" && hasValue) saveCatalogPath = argv[++i];
+    else if (arg == "--binary")             binary = true;
+    else if (arg == "--policy" && hasValue)
+    {
+      auto parsed = parseDeadlockPolicy(argv[++i]);
+      if (!parsed)
+      {
+        std::cerr << "política desconhecida: " << argv[i] << '\n';
+        return 2;
+      }
+      policy = *parsed;
+    }
+    else
+    {
+      std::cerr <<
+        "uso: 2v2pl [--trace <arquivo> [--out <arquivo> [--binary]] [--aborts <arquivo>]\n"
+        "             [--record <arquivo>]\n"
+        "             [--policy <detect|wait-die|wound-wait|no-wait|periodic>]]\n"
+        "             [--catalog <arquivo> [--save-catalog <arquivo>]]\n";
+      return 2;
+    }
+  }
+
+  sgbd::ResourceManager resManager;
+  if (catalogPath.empty())
+    populateData(resManager, 2, 5);
+  else if (!loadCatalog(resManager, catalogPath, saveCatalogPath))
+    return 1;
+
+  // só carregar o catálogo
+  if (tracePath.empty() && !catalogPath.empty())
+    return 0;
+
+  sgbd::MappedFile trace;
+  if (tracePath.empty() || !trace.open(tracePath))
+  {
+    std::cerr << "não foi possível abrir o trace: " << tracePath << '\n';
+    return 1;
+  }
+
+  std::ofstream outFile, abortsFile, recordFile;
+  if (!outPath.empty())
+    outFile.open(outPath, binary ? std::ios::binary : std::ios::out);
+  if (!abortsPath.empty())
+    abortsFile.open(abortsPath);
+  if (!recordPath.empty())
+    recordFile.open(recordPath, std::ios::binary);
+  if ((!outPath.empty() && !outFile) || (!abortsPath.empty() && !abortsFile) ||
+      (!recordPath.empty() && !recordFile))
+  {
+    std::cerr << "não foi possível criar os arquivos de saída\n";
+    return 1;
+  }
+  std::ostream& out = outPath.empty() ? std::cout : outFile;
+  std::ostream& aborts = abortsPath.empty() ? std::cerr : abortsFile;
+
+  sgbd::TransactionManager trManager;
+  sgbd::Scheduler scheduler(policy);
+
+  // o escalonamento binário só vai para arquivo
+  std::optional<sgbd::OperationLogWriter> outLog, record;
+  if (binary && !outPath.empty())
+    outLog.emplace(out);
+  if (!recordPath.empty())
+    record.emplace(recordFile);
+
+  sgbd::usize emitted = 0;
+  scheduler.setOutput({
+    [&](const sgbd::Operation& op)
+    {
+      if (outLog)
+        outLog->write(op);
+      else
+        showOperation(op, out);
+      emitted++;
+    },
+    [&](const sgbd::Transaction& tr) { aborts << "transação ( " << tr.id << " ) foi [abortada]\n"; },
+    {},
+  });
+
+  // o escalonamento só existe na saída, então as transações terminadas
+  // podem ser devolvidas logo
+  scheduler.setRetirement(&trManager);
+
+  auto start = std::chrono::steady_clock::now();
+  sgbd::TraceReplay replay(resManager, trManager, scheduler);
+  replay.setRecorder(record ? &*record : nullptr);
+  auto stats = replay.run(trace.view());
+  if (policy == sgbd::Scheduler::DeadlockPolicy::Periodic)
+    while (scheduler.detectDeadlocks()) {}
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  if (outLog)
+    outLog->flush();
+  if (record)
+    record->flush();
+  out.flush();
+  aborts.flush();
+  std::cerr
+    << "blocos:    " << stats.chunks     << '\n'
+    << "operações: " << stats.operations << '\n'
+    << "inválidas: " << stats.invalid    << '\n'
+    << "emitidas:  " << emitted          << '\n'
+    << "abortos:   " << scheduler.getStats().aborts << '\n'
+    << "vivas:     " << trManager.size() << " (" << trManager.capacity() << " slots)\n"
+    << "tempo:     " << elapsed.count()  << " s\n";
+  return 0;
+}
+
+int main(int argc, char** argv)
+{
+  if (argc > 1)
+  {
+    std::ios::sync_with_stdio(false);
+    return replayTrace(argc, argv);
+  }
+
   sgbd::ResourceManager resManager;  populateData(resManager, 2, 5);
   sgbd::TransactionManager trManager;
   sgbd::Scheduler scheduler;
 
+  // o aviso sai no abort: depois de schedule, com `retain`, o slot da
+  // transação já pode ter sido reciclado
+  scheduler.setOutput({
+    {},
+    [](const sgbd::Transaction& tr) { std::cout << "transação ( " << tr.id << " ) foi [abortada]\n"; },
+    {},
+  });
+
   std::cout <<
     "~[ Implementação 2v2pl ]~\n"
     "Comandos:\n"
     "    exit          - sai do programa\n"
     "    show          - mostra o estado do escalonamento atual\n"
     "    locki         - mostra o estado dos bloqueios\n"
+    "    stats         - mostra contadores do escalonador\n"
+    "    escal <p> <t> - limites de escalonamento de bloqueios por página e\n"
+    "                    por tabela (0 desativa)\n"
+    "    policy <nome> - política de deadlock: detect, wait-die, wound-wait,\n"
+    "                    no-wait, periodic\n"
+    "    deadlock      - procura ciclos de espera agora (política periodic)\n"
+    "    save <arq>    - grava o escalonamento atual no formato binário\n"
+    "    retain <n>    - guarda só as últimas n operações emitidas e devolve as\n"
+    "                    transações terminadas (0 guarda tudo)\n"
     "    test1 e test2 - executam operações de teste\n"
-    "    <op><trid>(<obj> [<upd>] [<res>])\n"
+    "    <op><trid>(<obj>[:<id>] [<upd>] [<res>])\n"
     "      onde:\n"
     "        <op>:   r, w, c\n"
     "        <trid>: id da transação\n"
     "        <obj>:  nome da tabela\n"
+    "        <id>:   tupla (rowl) ou página (pagl) alvo\n"
+    "                - sem id a operação bloqueia a tabela inteira\n"
     "        <upd>:  updl\n"
     "                - bloqueio de update (válido somente para leitura)\n"
     "        <res>:  rowl, tabl, pagl, arel\n"
@@ -132,6 +380,10 @@ int main()
     if (line == "exit")
       break;
 
+    // com a política periódica, um ciclo formado pela última operação só é
+    // desfeito aqui se nenhuma outra for escalonada
+    scheduler.tick();
+
     if (line == "show")
     {
       for (auto& op : scheduler.getScheduling())
@@ -156,6 +408,62 @@ int main()
       continue;
     }
 
+    if (line == "stats")
+    {
+      showStats(scheduler);
+      continue;
+    }
+
+    if (line.starts_with("escal "))
+    {
+      sgbd::Scheduler::Escalation escalation;
+      std::istringstream args(line.substr(6));
+      if (args >> escalation.pageThreshold >> escalation.tableThreshold)
+        scheduler.setEscalation(escalation);
+      else
+        std::cout << "uso: escal <página> <tabela>\n";
+      continue;
+    }
+
+    if (line.starts_with("policy "))
+    {
+      if (auto policy = parseDeadlockPolicy(std::string_view(line).substr(7)))
+        scheduler.setDeadlockPolicy(*policy);
+      else
+        std::cout << "uso: policy <detect|wait-die|wound-wait|no-wait|periodic>\n";
+      continue;
+    }
+
+    if (line.starts_with("retain "))
+    {
+      sgbd::usize retention;
+      std::istringstream args(line.substr(7));
+      if (args >> retention)
+      {
+        scheduler.setRetention(retention);
+        scheduler.setRetirement(retention ? &trManager : nullptr);
+      }
+      else
+        std::cout << "uso: retain <operações>\n";
+      continue;
+    }
+
+    if (line.starts_with("save "))
+    {
+      std::ofstream file(line.substr(5), std::ios::binary);
+      if (file)
+        sgbd::OperationLogWriter(file).write(scheduler.getScheduling());
+      else
+        std::cout << "não foi possível criar " << line.substr(5) << '\n';
+      continue;
+    }
+
+    if (line == "deadlock")
+    {
+      std::cout << "transações abortadas: " << scheduler.detectDeadlocks() << '\n';
+      continue;
+    }
+
     if (line == "test1")
     {
       line = "r4(v)r3(y)r1(y)r1(x)w2(u)r2(x)w1(y)r2(y)c1w4(u)r3(x)c4w2(x)c2w3(u)w3(z)c3";
@@ -172,11 +480,7 @@ int main()
     while (parser.hasNext())
     {
       if (auto op = parser.nextOperation())
-      {
         scheduler.schedule(*op);
-        if (op->tr->aborted)
-          std::cout << "transação ( " << op->tr->id << " ) foi [abortada]";
-      }
     }
   }
 
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <utility>
+#include <vector>
+
+namespace sgbd
+{
+
+/// @brief Nós extraídos de um unordered_map guardados para reuso.
+///
+/// Apagar com erase guarda o nó (e a memória que o valor já alocou) em vez de
+/// liberá-lo; insert reaproveita um nó guardado, então um mapa cujo tamanho
+/// oscila deixa de alocar depois de aquecido. Guarda no máximo `limit` nós.
+template <class Map>
+class NodePool
+{
+ public:
+  NodePool(usize limit = 1024) : m_limit(limit) {}
+
+  /// @brief Insere a chave, que não pode estar no mapa.
+  /// @param init Chamada com o valor inserido, novo ou de um nó reaproveitado.
+  /// @return Iterador para o elemento inserido.
+  template <class Init>
+  auto insert(Map& map, const typename Map::key_type& key, Init&& init) -> typename Map::iterator
+  {
+    typename Map::iterator it;
+    if (m_nodes.empty())
+      it = map.try_emplace(key).first;
+    else
+    {
+      auto node = std::move(m_nodes.back());
+      m_nodes.pop_back();
+      node.key() = key;
+      it = map.insert(std::move(node)).position;
+    }
+    init(it->second);
+    return it;
+  }
+
+  void erase(Map& map, typename Map::iterator it)
+  {
+    if (m_nodes.size() < m_limit)
+      m_nodes.push_back(map.extract(it));
+    else
+      map.erase(it);
+  }
+
+ private:
+  std::vector<typename Map::node_type> m_nodes;
+  usize m_limit;
+};
+
+} // namespace sgbd
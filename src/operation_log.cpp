@@ -0,0 +1,171 @@
+#include "operation_log.hpp"
+#include "varint.hpp"
+
+namespace sgbd
+{
+
+OperationLogWriter::OperationLogWriter(std::ostream& out)
+  : m_out(out)
+{
+  m_buffer.reserve(BufferSize);
+  m_buffer += oplog::Magic;
+}
+
+OperationLogWriter::~OperationLogWriter()
+{
+  flush();
+}
+
+void OperationLogWriter::write(const Operation& op)
+{
+  ubyte kind = oplog::CommitK;
+  const Table* table = nullptr;
+  bool update = false;
+  if (auto read = std::get_if<Operation::Read>(&op.type))
+  {
+    kind = oplog::ReadK;
+    table = read->table;
+    update = read->isUpdate;
+  }
+  else if (auto write = std::get_if<Operation::Write>(&op.type))
+  {
+    kind = oplog::WriteK;
+    table = write->table;
+  }
+
+  usize tableId = 0;
+  if (table)
+  {
+    auto [it, isNew] = m_tableIds.try_emplace(table, m_tableIds.size());
+    tableId = it->second;
+    if (isNew)
+    {
+      m_buffer += char(oplog::TableK);
+      putVarint(m_buffer, tableId);
+      putVarint(m_buffer, table->name.size());
+      m_buffer += table->name;
+    }
+  }
+
+  bool hasObj = op.obj != npos;
+  m_buffer += char(kind | ubyte(op.res) << 2 | ubyte(update) << 4 | ubyte(hasObj) << 5);
+  putVarint(m_buffer, op.tr->id);
+  if (table)
+    putVarint(m_buffer, tableId);
+  if (hasObj)
+    putVarint(m_buffer, op.obj);
+
+  if (m_buffer.size() >= BufferSize)
+    flush();
+}
+
+void OperationLogWriter::write(const std::vector<Operation>& ops)
+{
+  for (auto& op : ops)
+    write(op);
+}
+
+void OperationLogWriter::flush()
+{
+  m_out.write(m_buffer.data(), std::streamsize(m_buffer.size()));
+  m_buffer.clear();
+}
+
+OperationLogReader::OperationLogReader(std::string_view src, ResourceManager& rm,
+  TransactionManager& tm)
+    : m_src(src),
+      m_current(isOperationLog(src) ? oplog::Magic.size() : src.size()),
+      m_resManager(rm),
+      m_trManager(tm) {}
+
+bool OperationLogReader::isOperationLog(std::string_view src)
+{
+  return src.starts_with(oplog::Magic);
+}
+
+auto OperationLogReader::nextOperation() -> std::optional<Operation>
+{
+  usize trid;
+  auto op = nextUnresolved(trid);
+  if (op)
+    op->tr = m_trManager.registerTransaction(trid);
+  return op;
+}
+
+auto OperationLogReader::nextUnresolved(usize& trid) -> std::optional<Operation>
+{
+  while (hasNext())
+  {
+    ubyte tag = ubyte(m_src[m_current++]);
+    ubyte kind = tag & 3;
+
+    if (kind == oplog::TableK)
+    {
+      auto id = getVarint(m_src, m_current);
+      auto size = getVarint(m_src, m_current);
+      // os ids são densos e definidos em ordem; outro id é um log corrompido
+      if (!id || !size || *id != m_tables.size() || *size > m_src.size() - m_current)
+        break;
+
+      auto name = m_src.substr(m_current, *size);
+      m_current += *size;
+      m_tables.push_back(m_resManager.getTable(name));
+      continue;
+    }
+
+    auto tid = getVarint(m_src, m_current);
+    if (!tid)
+      break;
+    trid = *tid;
+
+    Table* table = nullptr;
+    if (kind != oplog::CommitK)
+    {
+      auto id = getVarint(m_src, m_current);
+      if (!id)
+        break;
+      table = *id < m_tables.size() ? m_tables[*id] : nullptr;
+    }
+
+    auto obj = npos;
+    if (tag & 1 << 5)
+    {
+      auto value = getVarint(m_src, m_current);
+      if (!value)
+        break;
+      obj = *value;
+    }
+
+    // a tabela não existe neste catálogo
+    if (kind != oplog::CommitK && !table)
+      return {};
+
+    Operation::Type type = Operation::Commit{};
+    if (kind == oplog::ReadK)
+      type = Operation::Read { table, bool(tag & 1 << 4) };
+    else if (kind == oplog::WriteK)
+      type = Operation::Write { table };
+
+    auto res = Operation::Resource((tag >> 2) & 3);
+    if (table && obj != npos)
+    {
+      if (res == Operation::Resource::Row && table->pageOf(obj) == npos)
+        return {};
+      if (res == Operation::Resource::Page && obj >= table->pageCount())
+        return {};
+    }
+
+    return Operation { nullptr, type, res, obj };
+  }
+
+  // registro truncado: nada depois dele pode ser lido
+  m_current = m_src.size();
+  return {};
+}
+
+bool OperationLogReader::hasNext()
+{
+  return m_current < m_src.size();
+}
+
+} // namespace sgbd
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "common.hpp"
+#include "table.hpp"
+#include "transaction.hpp"
+
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace sgbd
+{
+
+/// @brief Formato binário de operações.
+///
+/// O arquivo começa com Magic seguido de uma sequência de registros. Cada
+/// registro começa com um byte de tag:
+///   bits 0-1: tipo (0 leitura, 1 escrita, 2 commit, 3 definição de tabela)
+///   bits 2-3: granulosidade (Operation::Resource)
+///   bit 4:    leitura com updl
+///   bit 5:    possui objeto alvo
+/// Operações continuam com o id da transação, o id da tabela (leitura e
+/// escrita) e o objeto (se houver), todos em varint (LEB128). Uma definição
+/// de tabela traz o id, o tamanho do nome e o nome, e aparece antes da
+/// primeira operação que usa a tabela; os ids são 0, 1, ... na ordem das
+/// definições.
+namespace oplog
+{
+
+constexpr std::string_view Magic = "2v2l\x01";
+
+enum Kind : ubyte
+{
+  ReadK,
+  WriteK,
+  CommitK,
+  TableK,
+};
+
+} // namespace oplog
+
+/// @brief Escreve operações no formato binário.
+class OperationLogWriter
+{
+ public:
+  /// @brief Escreve o cabeçalho do formato em out.
+  OperationLogWriter(std::ostream& out);
+  ~OperationLogWriter();
+
+  OperationLogWriter(const OperationLogWriter&) = delete;
+  OperationLogWriter& operator=(const OperationLogWriter&) = delete;
+
+  void write(const Operation& op);
+
+  /// @brief Escreve todas as operações, e.g. Scheduler::getScheduling().
+  void write(const std::vector<Operation>& ops);
+
+  /// @brief Envia os registros acumulados para a stream.
+  void flush();
+
+ private:
+  static constexpr usize BufferSize = usize(1) << 16;
+
+  std::ostream& m_out;
+  std::string m_buffer;
+  std::unordered_map<const Table*, usize> m_tableIds;
+};
+
+/// @brief Lê operações no formato binário. Tem a mesma interface de
+/// OperationParser e lê direto do buffer, sem cópias.
+class OperationLogReader
+{
+ public:
+  OperationLogReader(std::string_view src, ResourceManager& rm, TransactionManager& tm);
+
+  /// @brief Verifica se src começa com o cabeçalho do formato.
+  static bool isOperationLog(std::string_view src);
+
+  /// @brief Lê a próxima operação.
+  /// @return A operação ou vazio se o registro for inválido (tabela
+  /// desconhecida, objeto fora da tabela ou registro truncado ou corrompido,
+  /// que encerra a leitura).
+  auto nextOperation() -> std::optional<Operation>;
+  /// @brief Como nextOperation, mas não registra a transação: op.tr fica
+  /// nulo e o id lido vai para trid, para ser resolvido por quem escalona.
+  auto nextUnresolved(usize& trid) -> std::optional<Operation>;
+  bool hasNext();
+
+ private:
+  std::string_view m_src;
+  usize m_current;
+
+  ResourceManager& m_resManager;
+  TransactionManager& m_trManager;
+  std::vector<Table*> m_tables;
+};
+
+} // namespace sgbd
@@ -10,6 +10,15 @@ OperationParser::OperationParser(std::string_view src, ResourceManager &rm,
     : Parser(src), m_resManager(rm), m_trManager(tm) {}
 
 auto OperationParser::nextOperation() -> std::optional<Operation>
+{
+  usize trid;
+  auto op = nextUnresolved(trid);
+  if (op)
+    op->tr = m_trManager.registerTransaction(trid);
+  return op;
+}
+
+auto OperationParser::nextUnresolved(usize& trid) -> std::optional<Operation>
 {
   auto op = consume().type;
   switch (op)
@@ -24,12 +33,14 @@ auto OperationParser::nextOperation() -> std::optional<Operation>
       return {};
   }
 
-  auto trid = consumeNumber();
-  if (!trid)
+  auto id = consumeNumber();
+  if (!id)
     return {};
+  trid = usize(*id);
 
   auto opType = std::optional<Operation::Type>();
   auto res = Operation::Resource::Row;
+  auto obj = npos;
 
   if (op != Parser::TokenType::Commit)
   {
@@ -40,10 +51,18 @@ auto OperationParser::nextOperation() -> std::optional<Operation>
     if (!tidTok)
       return {};
 
-    auto table = m_resManager.getTable(std::string(tidTok->lexeme));
+    auto table = m_resManager.getTable(tidTok->lexeme);
     if (!table)
       return {};
 
+    if (match(Parser::TokenType::Colon))
+    {
+      auto objId = consumeNumber();
+      if (!objId || *objId < 0)
+        return {};
+      obj = usize(*objId);
+    }
+
     switch (op)
     {
       case Parser::TokenType::Read:
@@ -59,6 +78,14 @@ auto OperationParser::nextOperation() -> std::optional<Operation>
     else if (match(TokenType::PagL)) res = Operation::Resource::Page;
     else if (match(TokenType::AreL)) res = Operation::Resource::Area;
 
+    if (obj != npos)
+    {
+      if (res == Operation::Resource::Row && table->pageOf(obj) == npos)
+        return {};
+      if (res == Operation::Resource::Page && obj >= table->pageCount())
+        return {};
+    }
+
     if (!consume(Parser::TokenType::RightParen))
       return {};
   }
@@ -67,7 +94,7 @@ auto OperationParser::nextOperation() -> std::optional<Operation>
   if (!opType)
     return {};
 
-  return Operation { m_trManager.registerTransaction(*trid), *opType, res };
+  return Operation { nullptr, *opType, res, obj };
 }
 
 bool OperationParser::hasNext()
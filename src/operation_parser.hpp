@@ -15,6 +15,9 @@ class OperationParser : private Parser
   OperationParser(std::string_view src, ResourceManager& rm, TransactionManager& tm);
 
   auto nextOperation() -> std::optional<Operation>;
+  /// @brief Como nextOperation, mas não registra a transação: op.tr fica
+  /// nulo e o id lido vai para trid, para ser resolvido por quem escalona.
+  auto nextUnresolved(usize& trid) -> std::optional<Operation>;
   bool hasNext();
 
  private:
@@ -1,7 +1,12 @@
 #include "parser.hpp"
 
+#include <cassert>
 #include <charconv>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 namespace sgbd
 {
 
@@ -15,11 +20,43 @@ bool isAlpha(char c)
   return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
 }
 
+/// @brief Fim da sequência de dígitos (Digits) ou letras que começa em p.
+/// Com SSE2 testa 16 bytes por vez enquanto houver 16 bytes até end.
+template <bool Digits>
+static const char* scanRun(const char* p, const char* end)
+{
+#ifdef __SSE2__
+  // c está na classe se (c - base) < count sem sinal; letras maiúsculas viram
+  // minúsculas com | 0x20 (nenhum outro byte cai em a-z)
+  const __m128i fold = _mm_set1_epi8(Digits ? 0 : 0x20);
+  const __m128i base = _mm_set1_epi8(Digits ? '0' : 'a');
+  const __m128i bias = _mm_set1_epi8(char(0x80));
+  const __m128i limit = _mm_set1_epi8(char((Digits ? 10 : 26) ^ 0x80));
+
+  while (end - p >= 16)
+  {
+    __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    __m128i offset = _mm_sub_epi8(_mm_or_si128(c, fold), base);
+    __m128i in = _mm_cmplt_epi8(_mm_xor_si128(offset, bias), limit);
+    unsigned mask = ~unsigned(_mm_movemask_epi8(in)) & 0xffff;
+    if (mask)
+      return p + __builtin_ctz(mask);
+    p += 16;
+  }
+#endif
+
+  while (p != end && (Digits ? isDigit(*p) : isAlpha(*p)))
+    p++;
+  return p;
+}
+
 Parser::Parser(std::string_view src)
   : m_src(src),
     m_start(0),
     m_current(0),
-    m_readTokens(0) {}
+    m_tokens {},
+    m_readTokens(0),
+    m_lexedTokens(0) {}
 
 auto Parser::readToken() -> Token
 {
@@ -31,19 +68,17 @@ auto Parser::readToken() -> Token
 
   char c = advance();
 
+  auto end = m_src.data() + m_src.size();
+
   if (isDigit(c))
   {
-    while (!isAtEnd() && isDigit(peek()))
-      advance();
-
+    m_current = scanRun<true>(m_src.data() + m_current, end) - m_src.data();
     return makeToken(TokenType::Number);
   }
 
   if (isAlpha(c))
   {
-    while (!isAtEnd() && isAlpha(peek()))
-      advance();
-
+    m_current = scanRun<false>(m_src.data() + m_current, end) - m_src.data();
     return makeToken(identifierType(m_src.substr(m_start, m_current - m_start)));
   }
 
@@ -51,6 +86,7 @@ auto Parser::readToken() -> Token
   {
     case '(': return makeToken(TokenType::LeftParen);
     case ')': return makeToken(TokenType::RightParen);
+    case ':': return makeToken(TokenType::Colon);
   }
 
   return makeError("Unexpected character.");
@@ -69,7 +105,7 @@ auto Parser::consume(TokenType type) -> std::optional<Token>
 auto Parser::consume() -> Token
 {
   peekToken();
-  return m_tokens[m_readTokens++];
+  return m_tokens[m_readTokens++ % m_tokens.size()];
 }
 
 auto Parser::consumeNumber() -> std::optional<int>
@@ -86,10 +122,14 @@ auto Parser::consumeNumber() -> std::optional<int>
 
 auto Parser::peekToken(usize at) -> Token
 {
-  while (m_tokens.size() <= m_readTokens + at)
-    m_tokens.push_back(readToken());
+  assert(at < MaxLookahead);
+
+  // a posição de um token ainda não consumido nunca sobrescreve o último
+  // consumido, que last() ainda pode pedir
+  while (m_lexedTokens <= m_readTokens + at)
+    m_tokens[m_lexedTokens++ % m_tokens.size()] = readToken();
 
-  return m_tokens[m_readTokens + at];
+  return m_tokens[(m_readTokens + at) % m_tokens.size()];
 }
 
 bool Parser::match(TokenType type)
@@ -102,7 +142,7 @@ bool Parser::match(TokenType type)
 
 auto Parser::last() -> Token
 {
-  return m_tokens[m_readTokens - 1];
+  return m_tokens[(m_readTokens - 1) % m_tokens.size()];
 }
 
 auto Parser::makeToken(TokenType type) -> Token
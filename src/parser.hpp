@@ -4,14 +4,19 @@
 #include "lock.hpp"
 #include "transaction.hpp"
 
+#include <array>
 #include <string_view>
 #include <optional>
-#include <vector>
 
 namespace sgbd
 {
 
 /// @brief Classe para análise de operações.
+///
+/// Os tokens são lidos sob demanda para um buffer circular de tamanho fixo,
+/// então a memória usada não depende do tamanho da entrada. Só os últimos
+/// MaxLookahead tokens ainda não consumidos e o último consumido ficam
+/// disponíveis.
 class Parser
 {
  public:
@@ -29,6 +34,7 @@ class Parser
     UpdL,
     LeftParen,
     RightParen,
+    Colon,
     Eof,
     Error,
   };
@@ -39,6 +45,10 @@ class Parser
     std::string_view lexeme;
   };
 
+ public:
+  /// @brief Maior `at` aceito por peekToken mais um.
+  static constexpr usize MaxLookahead = 7;
+
  public:
   Parser(std::string_view src);
 
@@ -49,6 +59,8 @@ class Parser
   auto consume() -> Token;
   auto consumeNumber() -> std::optional<int>;
 
+  /// @brief Token a `at` posições do próximo, sem consumir.
+  /// @param at Menor que MaxLookahead.
   auto peekToken(usize at = 0) -> Token;
   bool match(TokenType type);
   auto last() -> Token;
@@ -69,8 +81,11 @@ class Parser
   usize m_start;
   usize m_current;
 
-  std::vector<Token> m_tokens;
+  // m_tokens[i % size] guarda o i-ésimo token lido; [m_readTokens, m_lexedTokens)
+  // são os ainda não consumidos
+  std::array<Token, MaxLookahead + 1> m_tokens;
   usize m_readTokens;
+  usize m_lexedTokens;
 };
 
 } // namespace sgbd
@@ -1,5 +1,7 @@
 #include "scheduler.hpp"
 
+#include <algorithm>
+
 namespace sgbd
 {
 
@@ -15,227 +17,885 @@ Lock::Resource operationResToLockRes(Operation::Resource res)
   return Lock::Resource::Row;
 }
 
-void Scheduler::schedule(Operation op)
+/// @brief Normaliza o nível da operação (sem objeto alvo ela cobre a tabela
+/// inteira) e calcula a sua página.
+/// @return Página alvo (o próprio obj se o nível não for tupla).
+static usize targetOf(Table* t, Lock::Resource& res, usize obj)
 {
-  auto res = operationResToLockRes(op.res);
-  auto shouldSchedule =
-    std::visit(
-      [&, tr = op.tr](auto& op) { return schedule(tr, op, res); }, op.type);
+  if (obj == npos && (res == Lock::Resource::Row || res == Lock::Resource::Page))
+    res = Lock::Resource::Table;
+  return res == Lock::Resource::Row ? t->pageOf(obj) : obj;
+}
 
-  if (shouldSchedule) m_operations.push_back(op);
-  else op.tr->waiting.push_back(op);
+/// @brief Objeto bloqueado em um nível do caminho até o alvo.
+static usize objectAt(Lock::Resource level, usize page, usize obj)
+{
+  if (level == Lock::Resource::Page) return page;
+  if (level == Lock::Resource::Row) return obj;
+  return npos;
 }
 
-bool Scheduler::schedule(Transaction *tr, Operation::Read &read, Lock::Resource res)
+/// @brief Ordem de aquisição do lote: nível, escopo e objeto.
+static bool keyLess(const LockTable::Key& a, const LockTable::Key& b)
 {
-  if (tr->aborted)
-    return false;
+  if (a.res != b.res)
+    return a.res < b.res;
+  if (a.scope != b.scope)
+    return std::less<const void*>()(a.scope, b.scope);
+  return a.obj < b.obj;
+}
 
-  auto lockType = Lock::readLock(read.isUpdate, false);
-  bool wait = false;
-  switch (res)
+static constexpr Lock::Resource s_levels[] = {
+  Lock::Resource::Area, Lock::Resource::Table, Lock::Resource::Page, Lock::Resource::Row,
+};
+
+Scheduler::Scheduler(DeadlockPolicy policy)
+  : m_policy(policy) {}
+
+Scheduler::Scheduler(DeadlockPolicy policy, Escalation escalation)
+  : m_policy(policy), m_escalation(escalation) {}
+
+void Scheduler::setDeadlockPolicy(DeadlockPolicy policy)
+{
+  // as outras políticas supõem um grafo sem ciclos
+  if (m_policy == DeadlockPolicy::Periodic)
+    detectDeadlocks();
+  m_policy = policy;
+}
+
+usize Scheduler::detectDeadlocks()
+{
+  m_calls++;
+  std::vector<Transaction*> victims;
   {
-    case Lock::Resource::Row:
-      wait &= !requestRowLocks(lockType, tr, read.table);
-      if (tr->aborted)
-        break;
-      lockType = Lock::readLock(read.isUpdate, true);
+    std::lock_guard lock(m_graphMutex);
+    m_stats.detectionRuns++;
+    m_pendingWaits = 0;
+    m_lastDetection = std::chrono::steady_clock::now();
 
-    case Lock::Resource::Page:
-      wait &= !requestPageLocks(lockType, tr, read.table);
-      if (tr->aborted)
-        break;
-      lockType = Lock::readLock(read.isUpdate, true);
+    for (auto cycles = m_graph.findCycles(); !cycles.empty(); cycles = m_graph.findCycles())
+    {
+      for (auto& cycle : cycles)
+      {
+        m_stats.deadlocks++;
+        auto victim = m_transactions.at(cycle.front());
+        for (auto id : cycle)
+        {
+          auto tr = m_transactions.at(id);
+          if (tr->timestamp > victim->timestamp)
+            victim = tr;
+        }
+        abortTransaction(victim, AbortReason::Deadlock);
+        victims.push_back(victim);
+      }
+    }
+  }
 
-    case Lock::Resource::Table:
-      wait &= !requestTableLock(lockType, tr, read.table);
-      if (tr->aborted)
-        break;
-      lockType = Lock::readLock(read.isUpdate, true);
+  for (auto victim : victims)
+    releaseVictim(victim, nullptr);
+  wakeUp();
+  releaseRetired();
+  m_calls--;
+  return victims.size();
+}
 
-    case Lock::Resource::Area:
-      wait &= !requestAreaLock(lockType, tr, read.table);
-      break;
+void Scheduler::abort(Transaction *tr)
+{
+  m_calls++;
+  {
+    std::lock_guard lock(m_graphMutex);
+    if (!tr->committed)
+      abortTransaction(tr, AbortReason::External);
   }
-  return !wait;
+  releaseVictim(tr, nullptr);
+  wakeUp();
+  releaseRetired();
+  m_calls--;
 }
 
-bool Scheduler::schedule(Transaction *tr, Operation::Write &write, Lock::Resource res)
+auto Scheduler::getWaits() -> std::vector<std::pair<usize, usize>>
 {
-  if (tr->aborted)
-    return false;
+  std::vector<std::pair<usize, usize>> waits;
+  std::lock_guard lock(m_graphMutex);
+  m_graph.forEach([&](usize tr, const std::vector<usize>& waitsFor)
+  {
+    for (auto t : waitsFor)
+      waits.push_back({ tr, t });
+  });
+  return waits;
+}
 
-  auto lockType = Lock::writeLock(false);
-  bool wait = false;
-  switch (res)
+void Scheduler::unpin()
+{
+  releaseRetired();
+  m_calls--;
+}
+
+void Scheduler::schedule(Operation op)
+{
+  m_calls++;
+  auto tr = op.tr;
   {
-    case Lock::Resource::Row:
-      wait &= !requestRowLocks(lockType, tr, write.table);
-      if (tr->aborted)
-        break;
-      lockType = Lock::writeLock(true);
+    std::lock_guard lock(tr->mutex);
+    if (op.type.index() == Operation::CommitI)
+      tr->ended = true;
 
-    case Lock::Resource::Page:
-      wait &= !requestPageLocks(lockType, tr, write.table);
-      if (tr->aborted)
+    if (!tr->aborted && !tr->committed)
+    {
+      // operações seguintes de uma transação em espera aguardam a sua vez
+      if (!tr->waiting.empty())
+        tr->waiting.push_back(op);
+      else if (!execute(op) && !tr->aborted)
+        tr->waiting.push_back(op);
+    }
+  }
+  settle(tr);
+  wakeUp();
+  tick();
+  releaseRetired();
+  m_calls--;
+}
+
+void Scheduler::scheduleBatch(std::span<const Operation> ops)
+{
+  m_calls++;
+  thread_local Plan plan;
+
+  // cada sequência de operações da mesma transação é planejada de uma vez
+  for (usize first = 0, last; first < ops.size(); first = last)
+  {
+    auto tr = ops[first].tr;
+    for (last = first + 1; last < ops.size() && ops[last].tr == tr; last++);
+    auto run = ops.subspan(first, last - first);
+    {
+      std::lock_guard lock(tr->mutex);
+      for (auto& op : run)
+        if (op.type.index() == Operation::CommitI)
+          tr->ended = true;
+
+      if (!tr->aborted && !tr->committed)
+      {
+        usize done = 0;
+        if (tr->waiting.empty() && acquirePlan(tr, run, plan))
+        {
+          for (; done < run.size() && !tr->aborted && !tr->committed; done++)
+          {
+            auto op = run[done];
+            if (!execute(op, &plan))
+              break;
+          }
+        }
+
+        if (!tr->aborted && !tr->committed)
+          for (auto& op : run.subspan(done))
+            tr->waiting.push_back(op);
+      }
+    }
+    settle(tr);
+    wakeUp();
+  }
+
+  tick();
+  releaseRetired();
+  m_calls--;
+}
+
+bool Scheduler::acquirePlan(Transaction *tr, std::span<const Operation> ops, Plan& plan)
+{
+  plan.clear();
+  for (auto& op : ops)
+  {
+    Table* t;
+    Lock::Type type, intent;
+    if (auto read = std::get_if<Operation::Read>(&op.type))
+    {
+      t = read->table;
+      type = Lock::readLock(read->isUpdate, false);
+      intent = Lock::readLock(read->isUpdate, true);
+    }
+    else if (auto write = std::get_if<Operation::Write>(&op.type))
+    {
+      t = write->table;
+      type = Lock::writeLock(false);
+      intent = Lock::writeLock(true);
+    }
+    else continue;
+
+    auto res = operationResToLockRes(op.res);
+    auto page = targetOf(t, res, op.obj);
+    for (auto level : s_levels)
+    {
+      Lock lock { tr, t, objectAt(level, page, op.obj), level == res ? type : intent, Lock::Granted, level };
+      plan.push_back({ LockTable::keyOf(lock), t, ubyte(1 << lock.type) });
+      if (level == res)
         break;
-      lockType = Lock::writeLock(true);
+    }
+  }
+
+  // ancestrais antes dos descendentes e, em cada nível, sempre a mesma ordem
+  std::sort(plan.begin(), plan.end(), [](const Planned& a, const Planned& b)
+  {
+    return keyLess(a.key, b.key);
+  });
+
+  usize unique = 0;
+  for (auto& p : plan)
+  {
+    if (unique && plan[unique - 1].key == p.key)
+      plan[unique - 1].needed |= p.needed;
+    else
+      plan[unique++] = p;
+  }
+  plan.resize(unique);
 
-    case Lock::Resource::Table:
-      wait &= !requestTableLock(lockType, tr, write.table);
+  usize escalations = m_stats.pageEscalations + m_stats.tableEscalations;
+  for (auto& p : plan)
+  {
+    p.held = m_lockTable.grantedTypes(tr, p.key);
+
+    // do mais forte ao mais fraco: um tipo concedido cobre os seguintes
+    for (auto type : { Lock::Write, Lock::Update, Lock::Read, Lock::IUpdate, Lock::IWrite, Lock::IRead })
+    {
+      if (!(p.needed & (1 << type)) || Lock::coversAny(p.held, type))
+        continue;
+
+      // um bloqueio acima (e.g. escalonado) já cobre as operações do tipo
+      auto access = Lock::isIntent(type) ? Lock::Type(type - Lock::IRead) : type;
+      if (coveredAbove(plan, p, access))
+        continue;
+
+      // uma conversão não é um bloqueio fino novo
+      bool fine =
+        !Lock::isIntent(type) && !m_lockTable.holds(tr, p.key) &&
+        (p.key.res == Lock::Resource::Row || p.key.res == Lock::Resource::Page);
+
+      if (!requestLock({ tr, p.table, p.key.obj, type, Lock::Granted, p.key.res }))
+        return false;
+      p.held |= ubyte(1 << type);
+      if (!fine)
+        continue;
+
+      auto page = p.key.res == Lock::Resource::Row ? p.table->pageOf(p.key.obj) : p.key.obj;
+      countFineLock(tr, p.table, p.key.res, page);
       if (tr->aborted)
-        break;
-      lockType = Lock::writeLock(true);
+        return false;
 
-    case Lock::Resource::Area:
-      wait &= !requestAreaLock(lockType, tr, write.table);
+      // o escalonamento troca os bloqueios finos da tabela por um mais acima
+      if (auto now = m_stats.pageEscalations + m_stats.tableEscalations; now != escalations)
+      {
+        escalations = now;
+        for (auto& q : plan)
+        {
+          if (&q == &p + 1)
+            break;
+          if (q.table == p.table && q.key.res != Lock::Resource::Area)
+            q.held = m_lockTable.grantedTypes(tr, q.key);
+        }
+      }
+    }
+  }
+  return true;
+}
+
+bool Scheduler::coveredAbove(Plan& plan, const Planned& p, Lock::Type type)
+{
+  auto page = p.key.res == Lock::Resource::Row ? p.table->pageOf(p.key.obj) : p.key.obj;
+  for (auto level : s_levels)
+  {
+    if (level == p.key.res)
       break;
+
+    auto key = LockTable::keyOf({ nullptr, p.table, objectAt(level, page, p.key.obj), type, Lock::Granted, level });
+    if (auto q = findPlanned(plan, key); q && Lock::coversAny(q->held, type))
+      return true;
   }
-  return !wait;
+  return false;
 }
 
-bool Scheduler::schedule(Transaction *tr, Operation::Commit &commit, Lock::Resource res)
+auto Scheduler::findPlanned(Plan& plan, const LockTable::Key& key) -> Planned*
 {
-  if (tr->aborted)
+  auto it = std::lower_bound(plan.begin(), plan.end(), key, [](const Planned& p, const LockTable::Key& k)
+  {
+    return keyLess(p.key, k);
+  });
+  return it != plan.end() && it->key == key ? &*it : nullptr;
+}
+
+usize Scheduler::tick()
+{
+  if (m_policy != DeadlockPolicy::Periodic || !m_pendingWaits)
+    return 0;
+
+  bool due;
+  {
+    std::lock_guard lock(m_graphMutex);
+    bool byCount = m_detection.waitThreshold && m_pendingWaits >= m_detection.waitThreshold;
+    bool byTime =
+      m_detection.interval.count() &&
+      std::chrono::steady_clock::now() - m_lastDetection >= m_detection.interval;
+    due = byCount || byTime;
+  }
+  return due ? detectDeadlocks() : 0;
+}
+
+bool Scheduler::execute(Operation& op, Plan* plan)
+{
+  auto res = operationResToLockRes(op.res);
+  bool granted = std::visit(
+    [&, tr = op.tr](auto& type) { return schedule(tr, type, res, op.obj, plan); }, op.type);
+  if (!granted)
     return false;
 
-  for (auto it = m_lockInfo.rbegin(); it != m_lockInfo.rend(); ++it)
-    if (it->tr->id == tr->id && it->status == Lock::Waiting)
-      return false;
+  // preparada: espera o segundo commit sem emitir nem liberar nada
+  if (op.type.index() == Operation::CommitI && !op.tr->committed)
+  {
+    std::lock_guard lock(m_operationsMutex);
+    if (m_output.prepared)
+      m_output.prepared(*op.tr);
+    return true;
+  }
 
-  int convertedCount = 0, totalCount = 0;
-  for (auto& lock : m_lockInfo)
   {
-    if (lock.tr->id == tr->id && (lock.type == Lock::Write || lock.type == Lock::IWrite))
+    std::lock_guard lock(m_operationsMutex);
+    record(op);
+  }
+
+  // as novas versões só ficam visíveis depois de o commit ser emitido
+  if (op.type.index() == Operation::CommitI)
+  {
+    m_lockTable.release(op.tr);
+    eraseFineLocks(op.tr);
+  }
+  return true;
+}
+
+void Scheduler::resume(Transaction *tr)
+{
+  {
+    std::lock_guard lock(tr->mutex);
+    // abortada, settle libera (e aposenta se o commit já chegou)
+    if (!tr->committed && !tr->aborted)
     {
-      totalCount++;
-      auto rit = std::find_if(m_lockInfo.begin(), m_lockInfo.end(), [&lock](Lock& l)
-      {
-        return
-          (l.type == Lock::Read || l.type == Lock::IRead) &&
-          l.tr->id != lock.tr->id &&
-          lock.table == l.table;
-      });
-      if (rit != m_lockInfo.end())
+      if (auto blocker = m_lockTable.blockerOf(tr))
       {
-        lock.status = Lock::Waiting;
+        // continua esperando, talvez por outra transação
+        addWaitForEdge(tr, blocker, true);
       }
       else
       {
-        lock.status = Lock::Granted;
-        convertedCount++;
+        {
+          std::lock_guard graph(m_graphMutex);
+          m_graph.clearOut(tr->id);
+        }
+
+        while (!tr->aborted && !tr->waiting.empty())
+        {
+          // abortar a transação esvazia a lista, então a operação é copiada
+          auto op = tr->waiting.front();
+          if (!execute(op))
+            break;
+          tr->waiting.pop_front();
+        }
+      }
+    }
+  }
+  settle(tr);
+}
+
+void Scheduler::wakeUp()
+{
+  // vetores por thread, reaproveitados entre chamadas
+  thread_local std::vector<Transaction*> woken, unique;
+  thread_local std::vector<bool> resumed;
+
+  for (m_lockTable.takeWoken(woken); !woken.empty(); m_lockTable.takeWoken(woken))
+  {
+    unique.assign(woken.begin(), woken.end());
+    std::sort(unique.begin(), unique.end());
+    unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+    resumed.assign(unique.size(), false);
+
+    // cada transação uma vez, na ordem em que foi acordada
+    for (auto tr : woken)
+    {
+      auto i = std::lower_bound(unique.begin(), unique.end(), tr) - unique.begin();
+      if (!resumed[i])
+      {
+        resumed[i] = true;
+        resume(tr);
       }
-      lock.type = lock.type == Lock::Write ? Lock::Certify : Lock::ICertify;
     }
+    woken.clear();
   }
+}
+
+void Scheduler::settle(Transaction *tr)
+{
+  bool finished = tr->ended && (tr->committed || tr->aborted);
+  if (!tr->aborted && (!finished || tr->settled))
+    return;
+
+  std::lock_guard lock(tr->mutex);
+  if (tr->aborted)
+    releaseAborted(tr);
 
-  if (convertedCount != totalCount)
+  // com o mutex, ninguém mais executa a transação; um slot já reciclado é
+  // outra transação e só é aposentado quando ela também terminar
+  if (!tr->ended || (!tr->committed && !tr->aborted))
+    return;
+  tr->settled = true;
+  if (m_retirement && !tr->retired.exchange(true))
+    retire(tr);
+}
+
+void Scheduler::retire(Transaction *tr)
+{
+  std::lock_guard lock(m_operationsMutex);
+  // guardando todas as operações o slot nunca deixa de ser referenciado
+  if (!m_output.emit && !m_retention)
+    return;
+
+  m_retired.push_back({ m_stats.emitted, tr });
+  collectRetired();
+}
+
+void Scheduler::record(const Operation &op)
+{
+  m_stats.emitted++;
+  if (m_output.emit)
+    m_output.emit(op);
+  else if (!m_retention || m_operations.size() < m_retention)
+    m_operations.push_back(op);
+  else
+  {
+    m_operations[m_operationsHead] = op;
+    m_operationsHead = (m_operationsHead + 1) % m_retention;
+  }
+
+  if (!m_retired.empty())
+    collectRetired();
+}
+
+void Scheduler::collectRetired()
+{
+  // as operações guardadas são as últimas m_operations.size() emitidas
+  usize oldest = m_output.emit ? m_stats.emitted.load() : m_stats.emitted - m_operations.size();
+  while (!m_retired.empty() && m_retired.front().first <= oldest)
+  {
+    m_releasable.push_back(m_retired.front().second);
+    m_retired.pop_front();
+  }
+}
+
+void Scheduler::releaseRetired()
+{
+  // outras chamadas podem guardar ponteiros para transações já aposentadas
+  // (leitores, bloqueadoras, acordadas); sozinha e depois de wakeUp, nenhuma
+  // referência resta e quem entrar agora não as encontra mais
+  if (m_calls != 1)
+    return;
+
+  thread_local std::vector<Transaction*> ready;
+  {
+    std::lock_guard lock(m_operationsMutex);
+    if (m_releasable.empty())
+      return;
+    ready.swap(m_releasable);
+  }
+
+  for (auto tr : ready)
+    m_retirement->release(tr);
+  m_stats.retired += ready.size();
+  ready.clear();
+}
+
+void Scheduler::setRetention(usize operations)
+{
+  std::lock_guard lock(m_operationsMutex);
+  std::rotate(m_operations.begin(), m_operations.begin() + m_operationsHead, m_operations.end());
+  if (operations && m_operations.size() > operations)
+    m_operations.erase(m_operations.begin(), m_operations.end() - operations);
+  m_operationsHead = 0;
+  m_retention = operations;
+}
+
+auto Scheduler::getScheduling() -> std::vector<Operation>
+{
+  std::lock_guard lock(m_operationsMutex);
+  std::vector<Operation> operations;
+  operations.reserve(m_operations.size());
+  operations.insert(operations.end(), m_operations.begin() + m_operationsHead, m_operations.end());
+  operations.insert(operations.end(), m_operations.begin(), m_operations.begin() + m_operationsHead);
+  return operations;
+}
+
+bool Scheduler::schedule(Transaction *tr, Operation::Read &read, Lock::Resource res, usize obj,
+  Plan* plan)
+{
+  if (tr->aborted)
+    return false;
+
+  return requestLocks(tr, read.table, res, obj,
+    Lock::readLock(read.isUpdate, false), Lock::readLock(read.isUpdate, true), plan);
+}
+
+bool Scheduler::schedule(Transaction *tr, Operation::Write &write, Lock::Resource res, usize obj,
+  Plan* plan)
+{
+  if (tr->aborted)
+    return false;
+
+  return requestLocks(tr, write.table, res, obj,
+    Lock::writeLock(false), Lock::writeLock(true), plan);
+}
+
+bool Scheduler::schedule(Transaction *tr, Operation::Commit&, Lock::Resource, usize, Plan*)
+{
+  if (tr->aborted)
     return false;
 
-  m_lockInfo.remove_if([tr](Lock& lock)
+  // o segundo commit de uma transação preparada só efetiva
+  if (!tr->prepared && m_lockTable.isWaiting(tr))
+    return false;
+
+  // a liberação dos leitores acorda a transação para certificar de novo
+  thread_local std::vector<Transaction*> readers;
+  readers.clear();
+  if (!tr->prepared && !m_lockTable.certify(tr, readers))
   {
-    return lock.tr->id == tr->id && (lock.type == Lock::Read || lock.type == Lock::IRead);
-  });
+    std::sort(readers.begin(), readers.end(), [](Transaction* a, Transaction* b)
+    {
+      return a->id < b->id;
+    });
+    readers.erase(std::unique(readers.begin(), readers.end()), readers.end());
 
-  auto waiting = m_graph.remove(tr->id);
+    for (auto reader : readers)
+    {
+      addWaitForEdge(tr, reader);
+      if (tr->aborted)
+        break;
+    }
+    return false;
+  }
+
+  // uma transação ferida depois de certificar não pode mais efetivar
+  std::lock_guard lock(m_graphMutex);
+  if (tr->aborted)
+    return false;
+
+  if (tr->twoPhase && !tr->prepared)
+  {
+    tr->prepared = true;
+    return true;
+  }
+
+  tr->committed = true;
+  m_graph.remove(tr->id);
+  m_transactions.erase(tr->id);
+  return true;
+}
+
+bool Scheduler::requestLocks(Transaction *tr, Table *t, Lock::Resource res, usize obj,
+  Lock::Type type, Lock::Type intent, Plan* plan)
+{
+  auto page = targetOf(t, res, obj);
 
-  for (auto id : waiting)
+  bool wait = false;
+  for (auto level : s_levels)
   {
-    if (!m_graph.waitsForAny(id))
+    Lock lock { tr, t, objectAt(level, page, obj), type, Lock::Granted, level };
+
+    // o lote já sabe o que foi concedido em cada nível
+    if (plan)
     {
-      for (auto& lock : m_lockInfo)
+      if (auto p = findPlanned(*plan, LockTable::keyOf(lock)))
       {
-        if (lock.tr->id == id && lock.status == Lock::Waiting)
-        {
-          lock.status = Lock::Granted;
-          for (auto& op : lock.tr->waiting)
-            m_operations.push_back(op);
-          lock.tr->waiting.clear();
-        }
+        if (Lock::coversAny(p->held, type))
+          break;
+        if (level != res && Lock::coversAny(p->held, intent))
+          continue;
       }
     }
+
+    // um bloqueio já concedido neste nível (e.g. escalonado) cobre o alvo
+    if (m_lockTable.covers(lock))
+      break;
+
+    if (level != res)
+    {
+      lock.type = intent;
+      if (!m_lockTable.covers(lock))
+        wait = !requestLock(lock);
+    }
+    else
+    {
+      // uma conversão (e.g. Read -> Write) não é um bloqueio fino novo
+      bool fine =
+        (res == Lock::Resource::Row || res == Lock::Resource::Page) &&
+        !m_lockTable.holds(tr, LockTable::keyOf(lock));
+
+      wait = !requestLock(lock);
+      if (!tr->aborted && fine)
+        countFineLock(tr, t, res, page);
+    }
+
+    if (level == res || wait || tr->aborted)
+      break;
   }
+  return !wait && !tr->aborted;
+}
+
+void Scheduler::countFineLock(Transaction *tr, Table *t, Lock::Resource res, usize page)
+{
+  auto& fine = fineLocksOf(tr);
+  FineLocks::count(fine.tables, t)++;
 
+  if (res == Lock::Resource::Row)
+  {
+    auto rows = ++FineLocks::count(fine.pages, LockTable::Key { t, Lock::Resource::Page, page });
+    if (m_escalation.pageThreshold && rows > m_escalation.pageThreshold)
+      escalate(tr, t, Lock::Resource::Page, page);
+  }
+
+  if (m_escalation.tableThreshold && FineLocks::count(fine.tables, t) > m_escalation.tableThreshold)
+    escalate(tr, t, Lock::Resource::Table, npos);
+}
+
+bool Scheduler::escalate(Transaction *tr, Table *t, Lock::Resource res, usize obj)
+{
+  // os bloqueios do próprio nível ficam, o escalonado é somado a eles
+  auto folds = [&](const Lock& l)
+  {
+    if (l.table != t)
+      return false;
+    if (res == Lock::Resource::Page)
+      return l.res == Lock::Resource::Row && t->pageOf(l.obj) == obj;
+    return l.res == Lock::Resource::Page || l.res == Lock::Resource::Row;
+  };
+
+  auto mode = Lock::Read;
+  bool pending = false;
+  usize fineCount = 0, foldedCount = 0;
+  m_lockTable.forEach(tr, [&](Lock& l)
+  {
+    if (!folds(l))
+      return;
+
+    foldedCount++;
+    pending |= l.status != Lock::Granted;
+    if (!Lock::isIntent(l.type))
+    {
+      mode = Lock::strongest(mode, l.type);
+      fineCount++;
+    }
+  });
+
+  // bloqueios pendentes não podem ser agrupados
+  if (pending || !fineCount)
+    return false;
+
+  // concedido antes de soltar os finos, então o recurso nunca fica exposto
+  Lock escalated { tr, t, obj, mode, Lock::Granted, res };
+  if (m_lockTable.acquire(escalated, false))
+  {
+    m_stats.failedEscalations++;
+    return false;
+  }
+
+  m_lockTable.releaseIf(tr, folds);
+
+  auto& fine = fineLocksOf(tr);
+  if (res == Lock::Resource::Page)
+  {
+    LockTable::Key key { t, Lock::Resource::Page, obj };
+    std::erase_if(fine.pages, [&key](auto& page) { return page.first == key; });
+    FineLocks::count(fine.tables, t) -= fineCount - 1;
+    m_stats.pageEscalations++;
+  }
+  else
+  {
+    std::erase_if(fine.tables, [t](auto& table) { return table.first == t; });
+    std::erase_if(fine.pages, [t](auto& page) { return page.first.scope == t; });
+    m_stats.tableEscalations++;
+  }
+  m_stats.foldedLocks += foldedCount;
   return true;
 }
 
-bool Scheduler::requestRowLocks(Lock::Type type, Transaction *tr, Table *t)
+bool Scheduler::requestLock(Lock lock)
 {
-  auto conflict = getConflictLock(type, tr, t);
-  auto status = conflict ? Lock::Waiting : Lock::Granted;
-  for (auto& page : t->pages)
-    for (auto& row : page.rows)
-      m_lockInfo.emplace_back(tr, t, row.id, type, status, Lock::Resource::Row);
+  if (lock.tr->aborted)
+    return false;
 
-  if (conflict) addWaitForEdge(tr, conflict->tr);
+  auto blocker = m_lockTable.acquire(lock);
+  if (!blocker)
+    return true;
 
-  return !conflict;
+  // abortar quem segura o bloqueio (wound-wait) pode já tê-lo concedido
+  addWaitForEdge(lock.tr, blocker);
+  return !lock.tr->aborted && m_lockTable.covers(lock);
 }
 
-bool Scheduler::requestPageLocks(Lock::Type type, Transaction *tr, Table *t)
+void Scheduler::addWaitForEdge(Transaction *ti, Transaction *tj, bool replace)
 {
-  auto conflict = getConflictLock(type, tr, t);
-  auto status = conflict ? Lock::Waiting : Lock::Granted;
-  for (auto& page : t->pages)
-    m_lockInfo.emplace_back(tr, t, npos, type, status, Lock::Resource::Page);
+  std::vector<Transaction*> victims;
+  {
+    std::lock_guard lock(m_graphMutex);
+    if (replace)
+      m_graph.clearOut(ti->id);
 
-  if (conflict) addWaitForEdge(tr, conflict->tr);
+    // tj pode ter terminado depois de o conflito ser encontrado
+    if (ti->id == tj->id || ti->aborted || tj->aborted || tj->committed)
+      return;
 
-  return !conflict;
+    m_transactions.try_emplace(ti->id, ti);
+    m_transactions.try_emplace(tj->id, tj);
+    applyPolicy(ti, tj, victims);
+  }
+
+  for (auto victim : victims)
+    releaseVictim(victim, ti);
 }
 
-bool Scheduler::requestTableLock(Lock::Type type, Transaction *tr, Table *t)
+void Scheduler::applyPolicy(Transaction *ti, Transaction *tj, std::vector<Transaction*>& victims)
 {
-  auto conflict = getConflictLock(type, tr, t);
-  auto status = conflict ? Lock::Waiting : Lock::Granted;
-  m_lockInfo.emplace_back(tr, t, npos, type, status, Lock::Resource::Table);
+  // mais velha = menor timestamp
+  bool older = ti->timestamp < tj->timestamp;
+  switch (m_policy)
+  {
+    case DeadlockPolicy::Detect:
+      break;
 
-  if (conflict) addWaitForEdge(tr, conflict->tr);
+    case DeadlockPolicy::WaitDie:
+      if (!older)
+      {
+        abortTransaction(ti, AbortReason::Died);
+        victims.push_back(ti);
+      }
+      // só as mais velhas esperam, mas arestas de outra política (antes de
+      // setDeadlockPolicy) ainda podem fechar um ciclo
+      else if (!m_graph.add(ti->id, tj->id))
+      {
+        m_stats.deadlocks++;
+        abortTransaction(ti, AbortReason::Deadlock);
+        victims.push_back(ti);
+      }
+      return;
 
-  return !conflict;
+    case DeadlockPolicy::WoundWait:
+      // só quem coordena o commit em duas fases aborta uma preparada
+      if (older && !tj->prepared)
+      {
+        m_stats.wounds++;
+        abortTransaction(tj, AbortReason::Wounded);
+        victims.push_back(tj);
+      }
+      // esperando uma preparada mais nova, ti pode fechar um ciclo com quem
+      // espera por ela; a preparada não aborta, então ti desiste
+      else if (!m_graph.add(ti->id, tj->id))
+      {
+        m_stats.deadlocks++;
+        abortTransaction(ti, AbortReason::Deadlock);
+        victims.push_back(ti);
+      }
+      return;
+
+    case DeadlockPolicy::NoWait:
+      abortTransaction(ti, AbortReason::NoWait);
+      victims.push_back(ti);
+      return;
+
+    case DeadlockPolicy::Periodic:
+      m_graph.link(ti->id, tj->id);
+      m_pendingWaits++;
+      return;
+  }
+
+  // a aresta pode fechar vários ciclos; sem a vítima de um deles ti ainda
+  // espera por tj e a aresta é testada de novo
+  std::vector<usize> cycle;
+  while (!m_graph.add(ti->id, tj->id, &cycle))
+  {
+    m_stats.deadlocks++;
+    auto victim = ti;
+    for (auto id : cycle)
+    {
+      auto tr = m_transactions.at(id);
+      if (tr->timestamp > victim->timestamp)
+        victim = tr;
+    }
+
+    abortTransaction(victim, AbortReason::Deadlock);
+    victims.push_back(victim);
+    if (victim == ti || victim == tj)
+      return;
+  }
 }
 
-bool Scheduler::requestAreaLock(Lock::Type type, Transaction *tr, Table *t)
+void Scheduler::abortTransaction(Transaction *tr, AbortReason reason)
 {
-  auto conflict = getConflictLock(type, tr, t);
-  auto status = conflict ? Lock::Waiting : Lock::Granted;
-  m_lockInfo.emplace_back(tr, t, npos, type, status, Lock::Resource::Area);
+  // todos os aborts passam pelo mutex do grafo
+  if (tr->aborted)
+    return;
+  tr->abortReason = reason;
+  tr->aborted = true;
 
-  if (conflict) addWaitForEdge(tr, conflict->tr);
+  m_stats.aborts++;
+  m_graph.remove(tr->id);
+  m_transactions.erase(tr->id);
 
-  return !conflict;
+  if (m_output.abort)
+  {
+    std::lock_guard lock(m_operationsMutex);
+    m_output.abort(*tr);
+  }
 }
 
-Lock *Scheduler::getConflictLock(Lock::Type type, Transaction *tr, Table *t)
+void Scheduler::releaseVictim(Transaction *victim, Transaction *self)
 {
-  auto it = std::find_if(m_lockInfo.begin(), m_lockInfo.end(), [&](Lock& l)
+  if (victim == self)
   {
-    if (l.tr->id == tr->id && l.status == Lock::Waiting)
-      return false;
+    releaseAborted(victim);
+    return;
+  }
 
-    return
-      l.status != Lock::Waiting &&
-      l.tr->id != tr->id &&
-      l.table == t &&
-      !Lock::isCompatible(type, l.type);
-  });
-  return it != m_lockInfo.end() ? &*it : nullptr;
+  // se outra thread executa a vítima, settle libera quando ela terminar
+  std::unique_lock lock(victim->mutex, std::try_to_lock);
+  if (lock.owns_lock())
+    releaseAborted(victim);
 }
 
-void Scheduler::addWaitForEdge(Transaction *ti, Transaction *tj)
+void Scheduler::releaseAborted(Transaction *tr)
 {
-  if (ti->id == tj->id)
-    return;
+  m_lockTable.release(tr);
+  tr->waiting.clear();
+  eraseFineLocks(tr);
 
-  if (!m_graph.add(ti->id, tj->id))
-    abortTransaction(ti->timestamp < tj->timestamp ? tj : ti);
+  // o nó no grafo saiu no abort; com o commit já lido, nada mais é dela
+  if (tr->ended)
+    tr->settled = true;
 }
 
-void Scheduler::abortTransaction(Transaction *tr)
+auto Scheduler::fineLocksOf(Transaction *tr) -> FineLocks&
 {
-  tr->aborted = true;
+  std::lock_guard lock(m_fineMutex);
+  auto it = m_fineLocks.find(tr->id);
+  if (it == m_fineLocks.end())
+  {
+    it = m_finePool.insert(m_fineLocks, tr->id, [](FineLocks& fine)
+    {
+      fine.tables.clear();
+      fine.pages.clear();
+    });
+  }
+  return it->second;
+}
 
-  m_lockInfo.remove_if([tr](Lock& l) { return l.tr->id == tr->id; });
+void Scheduler::eraseFineLocks(Transaction *tr)
+{
+  std::lock_guard lock(m_fineMutex);
+  if (auto it = m_fineLocks.find(tr->id); it != m_fineLocks.end())
+    m_finePool.erase(m_fineLocks, it);
 }
 
 } // namespace sgbd
@@ -2,74 +2,390 @@
 
 #include "common.hpp"
 #include "lock.hpp"
+#include "lock_table.hpp"
+#include "node_pool.hpp"
 #include "transaction.hpp"
 #include "wait_for_graph.hpp"
 
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <span>
+#include <unordered_map>
+#include <utility>
 #include <vector>
-#include <list>
 
 namespace sgbd
 {
 
 /// @brief Escalonador 2v2pl
+///
+/// schedule pode ser chamado por várias threads ao mesmo tempo. As operações
+/// de uma mesma transação são serializadas por Transaction::mutex, a tabela de
+/// bloqueios trava só a partição do recurso e o grafo de espera (com a escolha
+/// de vítimas) tem o seu próprio mutex, tocado apenas quando há conflito.
+/// Nenhuma thread espera pelo mutex de uma transação enquanto segura o de
+/// outra: a vítima de um deadlock em execução em outra thread é liberada por
+/// essa thread ao terminar a operação.
 class Scheduler
 {
  public:
-  const std::vector<Operation>& getScheduling() const { return m_operations; }
-  const std::list<Lock>& getLockInfo() const { return m_lockInfo; }
+  /// @brief Política de tratamento de deadlocks.
+  enum class DeadlockPolicy : ubyte
+  {
+    Detect,    ///< Espera e aborta a transação mais nova de um ciclo de espera.
+    WaitDie,   ///< A mais velha espera, a mais nova é abortada.
+    WoundWait, ///< A mais velha aborta a mais nova, a mais nova espera.
+    NoWait,    ///< Aborta quem pede em qualquer conflito.
+    Periodic,  ///< Só registra as esperas; um detector procura ciclos de tempos em tempos.
+  };
+
+  /// @brief Gatilhos da detecção periódica (0 desativa o gatilho).
+  ///
+  /// Os gatilhos só são conferidos em schedule, scheduleBatch e tick: sem
+  /// novas operações, um ciclo formado pela última operação só é desfeito se
+  /// quem usa o escalonador chamar tick a cada interval, diretamente ou com um
+  /// DeadlockDetector.
+  struct Detection
+  {
+    usize waitThreshold = 64;               ///< Novas esperas até a próxima detecção.
+    std::chrono::milliseconds interval {50}; ///< Tempo máximo entre detecções.
+  };
+
+  /// @brief Limites para o escalonamento automático de bloqueios (0 desativa).
+  struct Escalation
+  {
+    usize pageThreshold = 64;   ///< Tuplas de uma página antes de bloquear a página.
+    usize tableThreshold = 256; ///< Bloqueios finos de uma tabela antes de bloquear a tabela.
+  };
+
+  /// @brief Destino do escalonamento emitido e dos abortos. Com emit definido
+  /// as operações não são guardadas em getScheduling. As funções são chamadas
+  /// uma de cada vez, com travas internas do escalonador, e não podem chamar o
+  /// escalonador.
+  struct Output
+  {
+    std::function<void(const Operation&)> emit;
+    std::function<void(const Transaction&)> abort;
+    /// Transação com Transaction::twoPhase que certificou todos os bloqueios.
+    std::function<void(const Transaction&)> prepared;
+  };
+
+  /// @brief Contadores de escalonamento de bloqueios.
+  struct Stats
+  {
+    std::atomic<usize> pageEscalations = 0;
+    std::atomic<usize> tableEscalations = 0;
+    std::atomic<usize> failedEscalations = 0;
+    std::atomic<usize> foldedLocks = 0;
+    std::atomic<usize> aborts = 0;
+    std::atomic<usize> deadlocks = 0;
+    std::atomic<usize> wounds = 0;
+    std::atomic<usize> detectionRuns = 0;
+    std::atomic<usize> emitted = 0;
+    std::atomic<usize> retired = 0;
+  };
+
+ public:
+  Scheduler() = default;
+  Scheduler(DeadlockPolicy policy);
+  Scheduler(DeadlockPolicy policy, Escalation escalation);
+
+  void setDeadlockPolicy(DeadlockPolicy policy);
+  DeadlockPolicy getDeadlockPolicy() const { return m_policy; }
+
+  // a configuração deve ser trocada sem threads escalonando
+  void setDetection(Detection detection) { m_detection = detection; }
+  const Detection& getDetection() const { return m_detection; }
+
+  void setEscalation(Escalation escalation) { m_escalation = escalation; }
+  const Escalation& getEscalation() const { return m_escalation; }
+  void setOutput(Output output) { m_output = std::move(output); }
+
+  /// @brief Quantas operações emitidas getScheduling guarda; as mais antigas
+  /// são descartadas (0 guarda todas).
+  void setRetention(usize operations);
+  usize getRetention() const { return m_retention; }
+
+  /// @brief Devolve ao gerenciador as transações terminadas: a efetivada
+  /// depois de o commit ser emitido e a abortada quando o seu commit chega.
+  /// Depois disso o mesmo id é uma transação nova. O slot só é reaproveitado
+  /// quando nenhuma operação guardada por getScheduling o referencia: logo
+  /// com Output::emit, quando sair da janela de retenção, ou nunca se todas
+  /// as operações forem guardadas.
+  /// @param manager Gerenciador que registrou as transações (nullptr desativa).
+  void setRetirement(TransactionManager* manager) { m_retirement = manager; }
+
+  const Stats& getStats() const { return m_stats; }
+  usize getLockCount() const { return m_lockTable.size(); }
+  usize getLockConversions() const { return m_lockTable.conversions(); }
+
+  /// @brief Cópia das operações emitidas guardadas, da mais antiga à mais nova.
+  auto getScheduling() -> std::vector<Operation>;
+
+  // as consultas abaixo não são sincronizadas com schedule
+  auto getLockInfo() -> std::vector<Lock> { return m_lockTable.snapshot(); }
   const WaitForGraph& getWaitForGraph() const { return m_graph; }
 
-  /// @brief Escalona uma operação ou coloca em espera.
+  /// @brief Escalona uma operação ou coloca em espera. Pode ser chamado por
+  /// várias threads.
   /// @param op
   void schedule(Operation op);
 
+  /// @brief Escalona um lote de operações, na ordem dada, como chamadas
+  /// seguidas a schedule. Antes de executar as operações de cada transação,
+  /// os bloqueios de que elas precisam são juntados por recurso (intenções
+  /// repetidas viram um único pedido e só o tipo mais forte de cada recurso é
+  /// pedido) e adquiridos numa única passada, ordenados por nível, tabela e
+  /// objeto. Se algum precisar esperar, as operações da transação vão todas
+  /// para a espera. Pode ser chamado por várias threads.
+  /// @param ops
+  void scheduleBatch(std::span<const Operation> ops);
+
+  /// @brief Procura todos os ciclos do grafo de espera e aborta, em cada um,
+  /// a transação mais nova até o grafo ficar sem ciclos.
+  /// @return Quantidade de transações abortadas.
+  usize detectDeadlocks();
+
+  /// @brief Roda detectDeadlocks se a política for Periodic e um gatilho de
+  /// Detection venceu. Pode ser chamado por várias threads.
+  /// @return Quantidade de transações abortadas.
+  usize tick();
+
+  /// @brief Aborta uma transação ainda não efetivada por decisão externa
+  /// (e.g. outro shard) e libera os seus bloqueios.
+  /// @param tr
+  void abort(Transaction* tr);
+
+  /// @brief Arestas do grafo de espera (ti espera por tj), copiadas com o
+  /// grafo travado.
+  auto getWaits() -> std::vector<std::pair<usize, usize>>;
+
+  /// @brief Enquanto houver um pin, nenhuma transação aposentada volta ao
+  /// gerenciador; quem guarda ponteiros para transações fora de uma chamada
+  /// ao escalonador deve segurar um. Pode ser chamado com travas internas
+  /// (e.g. dentro de Output); unpin não.
+  void pin() { m_calls++; }
+  void unpin();
+
  private:
+  /// @brief Recurso pedido pelas operações de um lote.
+  struct Planned
+  {
+    LockTable::Key key;
+    Table* table;
+    ubyte needed = 0; ///< Tipos pedidos pelas operações.
+    ubyte held = 0;   ///< Tipos concedidos à transação.
+  };
+
+  /// @brief Recursos de um lote ordenados por chave (nível, escopo, objeto).
+  using Plan = std::vector<Planned>;
+
+ private:
+  /// @brief Pede os bloqueios da operação e a emite se todos foram concedidos.
+  /// Requer Transaction::mutex.
+  /// @param op
+  /// @param plan Bloqueios já adquiridos pelo lote da operação (ou nullptr).
+  /// @return true se a operação foi emitida.
+  bool execute(Operation& op, Plan* plan = nullptr);
+
+  /// @brief Monta o plano das operações de leitura e escrita de ops e
+  /// adquire os seus bloqueios em ordem. Requer Transaction::mutex.
+  /// @param tr
+  /// @param ops Operações de tr.
+  /// @param plan
+  /// @return true se todos os bloqueios foram concedidos.
+  bool acquirePlan(Transaction* tr, std::span<const Operation> ops, Plan& plan);
+
+  /// @brief Verifica se um bloqueio concedido em um ancestral do recurso
+  /// cobre type.
+  bool coveredAbove(Plan& plan, const Planned& p, Lock::Type type);
+
+  /// @brief Recurso do plano com a chave (nullptr se não houver).
+  static auto findPlanned(Plan& plan, const LockTable::Key& key) -> Planned*;
+
+  /// @brief Reexecuta as operações em espera da transação, em ordem, até a
+  /// primeira que ainda precisa esperar, ou refaz a sua aresta de espera se
+  /// o bloqueio pedido continua em conflito.
+  /// @param tr
+  void resume(Transaction* tr);
+
+  /// @brief Retoma as transações afetadas pelas liberações de bloqueios até
+  /// não haver mais nenhuma.
+  void wakeUp();
+
+  /// @brief Libera os bloqueios de uma transação abortada e aposenta a
+  /// transação terminada. Não requer Transaction::mutex.
+  /// @param tr
+  void settle(Transaction* tr);
+
+  /// @brief Coloca a transação na fila de devolução ao gerenciador. Requer
+  /// Transaction::mutex.
+  void retire(Transaction* tr);
+
+  /// @brief Guarda uma operação emitida respeitando a janela de retenção.
+  /// Requer m_operationsMutex.
+  void record(const Operation& op);
+
+  /// @brief Move para m_releasable as transações aposentadas que nenhuma
+  /// operação guardada referencia. Requer m_operationsMutex.
+  void collectRetired();
+
+  /// @brief Devolve m_releasable ao gerenciador se nenhuma outra chamada
+  /// estiver em andamento. Só é chamado no fim de schedule e detectDeadlocks,
+  /// sem nenhum Transaction::mutex, já que registerTransaction trava o mutex
+  /// do slot com o mutex do gerenciador.
+  void releaseRetired();
+
   /// @brief Gerencia os bloqueios do novo escalonamento.
   /// @param tr Ponteiro para a transação.
   /// @param read
   /// @param res Nível de granulosidade.
+  /// @param obj Tupla ou página alvo.
+  /// @param plan
   /// @return true se for possível escalonar
-  bool schedule(Transaction* tr, Operation::Read& read, Lock::Resource res);
+  bool schedule(Transaction* tr, Operation::Read& read, Lock::Resource res, usize obj, Plan* plan);
 
   /// @brief Gerencia os bloqueios do novo escalonamento.
   /// @param tr Ponteiro para a transação.
   /// @param write
   /// @param res Nível de granulosidade.
+  /// @param obj Tupla ou página alvo.
+  /// @param plan
   /// @return true se for possível escalonar
-  bool schedule(Transaction* tr, Operation::Write& write, Lock::Resource res);
+  bool schedule(Transaction* tr, Operation::Write& write, Lock::Resource res, usize obj, Plan* plan);
 
   /// @brief Gerencia os bloqueios do novo escalonamento.
   /// @param tr Ponteiro para a transação.
   /// @param commit
   /// @param res Nível de granulosidade.
+  /// @param obj Tupla ou página alvo.
+  /// @param plan
   /// @return true se for possível escalonar
-  bool schedule(Transaction* tr, Operation::Commit& commit, Lock::Resource res);
+  bool schedule(Transaction* tr, Operation::Commit& commit, Lock::Resource res, usize obj, Plan* plan);
+
+  /// @brief Bloqueia o objeto alvo e coloca bloqueios de intenção em seus
+  /// ancestrais (área -> tabela -> página -> tupla).
+  /// @param tr
+  /// @param t Tabela alvo.
+  /// @param res Nível de granulosidade.
+  /// @param obj Tupla ou página alvo (npos bloqueia a tabela inteira).
+  /// @param type Bloqueio do objeto alvo.
+  /// @param intent Bloqueio de intenção dos ancestrais.
+  /// @param plan Os níveis concedidos no plano são pulados sem consultar a
+  /// tabela de bloqueios (pode ser nullptr).
+  /// @return true se todos os bloqueios foram concedidos. Para no primeiro
+  /// bloqueio em espera; os níveis já concedidos são pulados ao reexecutar.
+  bool requestLocks(Transaction* tr, Table* t, Lock::Resource res, usize obj,
+    Lock::Type type, Lock::Type intent, Plan* plan = nullptr);
 
-  bool requestRowLocks(Lock::Type type, Transaction* tr, Table* t);
-  bool requestPageLocks(Lock::Type type, Transaction* tr, Table* t);
-  bool requestTableLock(Lock::Type type, Transaction* tr, Table* t);
-  bool requestAreaLock(Lock::Type type, Transaction* tr, Table* t);
+  /// @brief Contabiliza um novo bloqueio fino e escalona os bloqueios da
+  /// transação se algum limite foi ultrapassado.
+  /// @param tr
+  /// @param t Tabela alvo.
+  /// @param res Nível do novo bloqueio (tupla ou página).
+  /// @param page Página do novo bloqueio.
+  void countFineLock(Transaction* tr, Table* t, Lock::Resource res, usize page);
 
-  /// @brief Procura por um bloqueio conflitante.
-  /// @param type
+  /// @brief Troca os bloqueios finos da transação sob o recurso por um único
+  /// bloqueio no recurso, com o modo mais forte entre eles.
   /// @param tr
-  /// @param t
-  /// @return Ponteiro para o primeiro bloqueio conflitante e nullptr se não encontrar.
-  Lock* getConflictLock(Lock::Type type, Transaction* tr, Table* t);
+  /// @param t Tabela alvo.
+  /// @param res Página ou tabela.
+  /// @param obj Página alvo (npos para a tabela).
+  /// @return true se o escalonamento foi feito.
+  bool escalate(Transaction* tr, Table* t, Lock::Resource res, usize obj);
+
+  /// @brief Concede o bloqueio ou o coloca em espera pelo bloqueio conflitante.
+  /// @param lock
+  /// @return true se o bloqueio foi concedido.
+  bool requestLock(Lock lock);
 
-  /// @brief Adiciona uma aresta no grafo de espera e lida com aborts.
-  /// @param ti
+  /// @brief Aplica a política de deadlock quando ti precisa esperar por tj.
+  /// Ao retornar ti pode ter sido abortada (esperar não é permitido), tj
+  /// pode ter sido abortada (o conflito foi desfeito) ou ti espera por tj.
+  /// @param ti Transação cujo mutex é detido pela thread atual.
   /// @param tj
-  void addWaitForEdge(Transaction* ti, Transaction* tj);
+  /// @param replace true para descartar as esperas anteriores de ti.
+  void addWaitForEdge(Transaction* ti, Transaction* tj, bool replace = false);
 
-  /// @brief Aborta a transação.
+  /// @brief Decide, com o grafo travado, se ti espera por tj.
+  /// @param victims Recebe as transações abortadas pela política.
+  void applyPolicy(Transaction* ti, Transaction* tj, std::vector<Transaction*>& victims);
+
+  /// @brief Marca a transação como abortada e a retira do grafo. Requer o
+  /// mutex do grafo; os bloqueios são liberados por releaseVictim.
   /// @param tr
-  void abortTransaction(Transaction* tr);
+  /// @param reason
+  void abortTransaction(Transaction* tr, AbortReason reason);
+
+  /// @brief Libera os bloqueios da vítima agora se possível.
+  /// @param victim
+  /// @param self Transação cujo mutex é detido pela thread atual (ou nullptr).
+  void releaseVictim(Transaction* victim, Transaction* self);
+
+  /// @brief Desfaz o estado de uma transação abortada. Requer
+  /// Transaction::mutex.
+  void releaseAborted(Transaction* tr);
+
+ private:
+  /// @brief Bloqueios finos (tupla/página) de uma transação. Uma transação
+  /// toca poucas tabelas e páginas (o escalonamento agrupa o resto), então
+  /// vetores com busca linear bastam e mantêm a capacidade ao reaproveitar.
+  struct FineLocks
+  {
+    std::vector<std::pair<Table*, usize>> tables;
+    std::vector<std::pair<LockTable::Key, usize>> pages;
+
+    /// @brief Contador da chave, criado com 0 se não existir.
+    template <class K>
+    static usize& count(std::vector<std::pair<K, usize>>& counts, const K& key)
+    {
+      for (auto& [k, n] : counts)
+        if (k == key)
+          return n;
+      return counts.emplace_back(key, 0).second;
+    }
+  };
+
+  /// @brief Bloqueios finos da transação, usados com Transaction::mutex.
+  auto fineLocksOf(Transaction* tr) -> FineLocks&;
+  void eraseFineLocks(Transaction* tr);
 
  private:
+  std::atomic<DeadlockPolicy> m_policy = DeadlockPolicy::Detect;
+  Escalation m_escalation;
+  Detection m_detection;
+  Stats m_stats;
+
+  std::mutex m_fineMutex;
+  std::unordered_map<usize, FineLocks> m_fineLocks;
+  NodePool<std::unordered_map<usize, FineLocks>> m_finePool;
+
+  // protegidos por m_operationsMutex; com retenção m_operations é um anel
+  // cujo elemento mais antigo está em m_operationsHead
+  std::mutex m_operationsMutex;
   std::vector<Operation> m_operations;
-  std::list<Lock> m_lockInfo;
+  usize m_operationsHead = 0;
+  usize m_retention = 0;
+  Output m_output;
+
+  // transações aposentadas e o total de operações emitidas ao aposentá-las
+  TransactionManager* m_retirement = nullptr;
+  std::deque<std::pair<usize, Transaction*>> m_retired;
+  std::vector<Transaction*> m_releasable;
+  std::atomic<usize> m_calls = 0; ///< schedule e detectDeadlocks em andamento.
+
+  LockTable m_lockTable;
+
+  // protegidos por m_graphMutex
+  std::mutex m_graphMutex;
   WaitForGraph m_graph;
+  std::unordered_map<usize, Transaction*> m_transactions;
+  std::atomic<usize> m_pendingWaits = 0;
+  std::chrono::steady_clock::time_point m_lastDetection = std::chrono::steady_clock::now();
 };
 
 } // namespace sgbd
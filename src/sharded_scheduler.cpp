@@ -0,0 +1,484 @@
+#include "sharded_scheduler.hpp"
+
+#include "wait_for_graph.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <string_view>
+
+namespace sgbd
+{
+
+ShardedScheduler::ShardedScheduler(ResourceManager& rm, usize shards, Routing routing,
+  Scheduler::DeadlockPolicy policy)
+    : m_routing(routing)
+{
+  shards = std::max<usize>(shards, 1);
+  for (usize i = 0; i < shards; i++)
+  {
+    auto& shard = *m_shards.emplace_back(std::make_unique<Shard>(policy));
+    shard.scheduler.setRetirement(&shard.branches);
+    shard.scheduler.setOutput({
+      [this, i](const Operation& op) { onEmit(i, op); },
+      [this, i](const Transaction& tr) { onAbort(i, tr); },
+      [this, i](const Transaction& tr) { onPrepared(i, tr); },
+    });
+  }
+
+  // em ordem de nome, para a divisão não depender da ordem do mapa
+  std::vector<Table*> tables;
+  std::vector<Table::Area*> areas;
+  rm.forEachTable([&](Table& t)
+  {
+    tables.push_back(&t);
+    areas.push_back(t.area);
+  });
+  std::sort(tables.begin(), tables.end(), [](Table* a, Table* b) { return a->name < b->name; });
+  std::sort(areas.begin(), areas.end(), [](Table::Area* a, Table::Area* b) { return a->id < b->id; });
+  areas.erase(std::unique(areas.begin(), areas.end()), areas.end());
+
+  for (usize i = 0; i < tables.size(); i++)
+    m_tableShards[tables[i]] = i % shards;
+  for (usize i = 0; i < areas.size(); i++)
+    m_areaShards[areas[i]] = i % shards;
+}
+
+auto ShardedScheduler::shardsOf(const Table* table, Operation::Resource res) const
+  -> std::pair<usize, usize>
+{
+  usize count = m_shards.size();
+  usize shard;
+  if (m_routing == Routing::Area)
+  {
+    auto it = m_areaShards.find(table->area);
+    shard = it != m_areaShards.end()
+      ? it->second
+      : std::hash<std::string_view>()(table->area->id) % count;
+  }
+  else
+  {
+    // a área está em todos os shards que têm tabelas dela
+    if (res == Operation::Resource::Area)
+      return { 0, count };
+
+    auto it = m_tableShards.find(table);
+    shard = it != m_tableShards.end()
+      ? it->second
+      : std::hash<std::string_view>()(table->name) % count;
+  }
+  return { shard, shard + 1 };
+}
+
+usize ShardedScheduler::getLockCount() const
+{
+  usize count = 0;
+  for (auto& shard : m_shards)
+    count += shard->scheduler.getLockCount();
+  return count;
+}
+
+auto ShardedScheduler::getScheduling() -> std::vector<Operation>
+{
+  std::lock_guard lock(m_outputMutex);
+  return m_operations;
+}
+
+void ShardedScheduler::schedule(Operation op)
+{
+  auto tr = op.tr;
+  if (op.type.index() == Operation::CommitI)
+    tr->ended = true;
+
+  auto record = findOrCreate(tr);
+  if (!record)
+    return;
+
+  auto& sends = sendBuffer();
+  {
+    std::lock_guard lock(record->mutex);
+    if (record->phase != Phase::Active)
+      return;
+
+    // uma operação por vez: a próxima sai quando a atual for emitida
+    if (record->inFlight || !record->queue.empty())
+    {
+      // também é uma espera: a transação pode estar presa num ciclo entre shards
+      record->queue.push_back(op);
+      m_pendingWaits++;
+    }
+    else
+      prepare(*record, op, sends);
+  }
+  if (!sends.empty())
+    send(record, sends);
+  drain();
+  tick();
+}
+
+usize ShardedScheduler::detectDeadlocks()
+{
+  usize victims = 0;
+  for (auto& shard : m_shards)
+  {
+    victims += shard->scheduler.detectDeadlocks();
+    drain();
+  }
+
+  {
+    std::lock_guard lock(m_detectionMutex);
+    m_stats.detectionRuns++;
+    m_pendingWaits = 0;
+    m_lastDetection = std::chrono::steady_clock::now();
+  }
+
+  // os ramos têm o id da transação global, então as arestas se juntam
+  WaitForGraph graph;
+  for (auto& shard : m_shards)
+    for (auto [ti, tj] : shard->scheduler.getWaits())
+      graph.link(ti, tj);
+
+  for (auto cycles = graph.findCycles(); !cycles.empty(); cycles = graph.findCycles())
+  {
+    for (auto& cycle : cycles)
+    {
+      // a mais nova que ainda pode ser abortada: o commit de um único shard
+      // é decidido pelo próprio shard
+      Record victim;
+      for (auto id : cycle)
+      {
+        auto record = find(id);
+        if (!record || (victim && record->tr->timestamp < victim->tr->timestamp))
+          continue;
+
+        std::lock_guard lock(record->mutex);
+        if (record->phase == Phase::Active || record->phase == Phase::Preparing)
+          victim = record;
+      }
+
+      // sem vítima as arestas são antigas (a transação já terminou); tirar
+      // um membro basta para o laço terminar
+      if (!victim)
+      {
+        graph.remove(cycle.front());
+        continue;
+      }
+      graph.remove(victim->tr->id);
+
+      std::lock_guard lock(victim->mutex);
+      if (victim->phase != Phase::Active && victim->phase != Phase::Preparing)
+        continue;
+
+      m_stats.globalDeadlocks++;
+      abortLocked(*victim, npos, AbortReason::Deadlock);
+      victims++;
+    }
+  }
+  drain();
+  return victims;
+}
+
+auto ShardedScheduler::find(usize id) -> Record
+{
+  auto& bucket = bucketOf(id);
+  std::lock_guard lock(bucket.mutex);
+  auto it = bucket.records.find(id);
+  return it != bucket.records.end() ? it->second : nullptr;
+}
+
+auto ShardedScheduler::findOrCreate(Transaction* tr) -> Record
+{
+  auto& bucket = bucketOf(tr->id);
+  std::lock_guard lock(bucket.mutex);
+
+  // o registro é esquecido depois de a transação terminar, com o bucket travado
+  if (tr->aborted || tr->committed)
+    return nullptr;
+
+  auto& record = bucket.records[tr->id];
+  if (!record)
+  {
+    record = std::make_shared<Coordinated>();
+    record->tr = tr;
+    record->branches.resize(m_shards.size(), nullptr);
+  }
+  return record;
+}
+
+void ShardedScheduler::forget(usize id)
+{
+  auto& bucket = bucketOf(id);
+  std::lock_guard lock(bucket.mutex);
+  bucket.records.erase(id);
+}
+
+void ShardedScheduler::prepare(Coordinated& c, const Operation& op, Sends& sends)
+{
+  c.current = op;
+
+  if (op.type.index() == Operation::CommitI)
+  {
+    for (usize s = 0; s < c.branches.size(); s++)
+      if (c.branches[s])
+        sends.push_back({ s, Operation { c.branches[s], op.type, op.res, op.obj } });
+
+    // nenhuma operação: nada a certificar
+    if (sends.empty())
+    {
+      c.phase = Phase::Finished;
+      c.tr->committed = true;
+      m_stats.commits++;
+      emit(op);
+      forget(c.tr->id);
+      return;
+    }
+
+    bool distributed = sends.size() > 1;
+    for (auto& [s, branchOp] : sends)
+      branchOp.tr->twoPhase = distributed;
+    c.phase = distributed ? Phase::Preparing : Phase::Committing;
+  }
+  else
+  {
+    auto table = op.type.index() == Operation::ReadI
+      ? std::get<Operation::Read>(op.type).table
+      : std::get<Operation::Write>(op.type).table;
+
+    auto [first, last] = shardsOf(table, op.res);
+    for (auto s = first; s < last; s++)
+      sends.push_back({ s, Operation { c.branches[s], op.type, op.res, op.obj } });
+  }
+  c.inFlight = sends.size();
+}
+
+void ShardedScheduler::send(const Record& record, Sends& sends)
+{
+  auto& c = *record;
+
+  // registerTransaction trava o mutex do slot, então os ramos novos são
+  // criados sem Coordinated::mutex
+  bool created = false;
+  for (auto& [s, op] : sends)
+  {
+    if (op.tr)
+      continue;
+    op.tr = m_shards[s]->branches.registerTransaction(c.tr->id);
+    op.tr->timestamp = c.tr->timestamp;
+    created = true;
+  }
+
+  if (created)
+  {
+    std::unique_lock lock(c.mutex);
+
+    // abortada enquanto os ramos eram criados: os novos nunca foram usados e
+    // voltam ao shard fora da trava (release trava o mutex do slot)
+    if (c.phase == Phase::Finished)
+    {
+      for (auto& [s, op] : sends)
+        if (c.branches[s])
+          op.tr = nullptr;
+      lock.unlock();
+
+      for (auto& [s, op] : sends)
+        if (op.tr)
+          m_shards[s]->branches.release(op.tr);
+      sends.clear();
+      return;
+    }
+
+    for (auto& [s, op] : sends)
+      c.branches[s] = op.tr;
+  }
+
+  for (auto& [s, op] : sends)
+    m_shards[s]->scheduler.schedule(op);
+  sends.clear();
+
+  std::lock_guard lock(c.mutex);
+  if (c.phase != Phase::Finished && c.inFlight)
+    m_pendingWaits++;
+}
+
+void ShardedScheduler::abortLocked(Coordinated& c, usize except, AbortReason reason)
+{
+  c.phase = Phase::Finished;
+  c.tr->abortReason = reason;
+  c.tr->aborted = true;
+  c.queue.clear();
+  m_stats.aborts++;
+
+  if (m_output.abort)
+  {
+    std::lock_guard lock(m_outputMutex);
+    m_output.abort(*c.tr);
+  }
+
+  // o pin impede que um ramo abortado pelo seu shard seja reciclado antes
+  // de drain chamar Scheduler::abort
+  Task task { Task::Abort, nullptr, {}, c.current };
+  for (usize s = 0; s < c.branches.size(); s++)
+  {
+    if (s == except || !c.branches[s])
+      continue;
+    m_shards[s]->scheduler.pin();
+    task.branches.push_back({ s, c.branches[s] });
+  }
+  if (!task.branches.empty())
+    pendingTasks().push_back(std::move(task));
+
+  forget(c.tr->id);
+}
+
+void ShardedScheduler::emit(const Operation& op)
+{
+  m_stats.emitted++;
+  std::lock_guard lock(m_outputMutex);
+  if (m_output.emit)
+    m_output.emit(op);
+  else
+    m_operations.push_back(op);
+}
+
+void ShardedScheduler::onEmit(usize shard, const Operation& op)
+{
+  auto record = find(op.tr->id);
+  if (!record)
+    return;
+
+  auto& c = *record;
+  std::lock_guard lock(c.mutex);
+  if (c.branches[shard] != op.tr || !c.inFlight || --c.inFlight)
+    return;
+
+  // o último shard emitiu: a operação global é emitida uma única vez
+  if (c.phase == Phase::Active)
+  {
+    emit(c.current);
+    if (!c.queue.empty())
+      pendingTasks().push_back({ Task::Next, record, {}, c.current });
+  }
+  else if (c.phase == Phase::Committing)
+  {
+    c.phase = Phase::Finished;
+    c.tr->committed = true;
+    m_stats.commits++;
+    emit(c.current);
+    forget(c.tr->id);
+  }
+}
+
+void ShardedScheduler::onAbort(usize shard, const Transaction& branch)
+{
+  auto record = find(branch.id);
+  if (!record)
+    return;
+
+  auto& c = *record;
+  std::lock_guard lock(c.mutex);
+  if (c.branches[shard] != &branch)
+    return;
+
+  // o commit deste ramo não vai chegar; terminado, o shard o devolve
+  c.branches[shard]->ended = true;
+  if (c.phase != Phase::Finished)
+    abortLocked(c, shard, branch.abortReason);
+}
+
+void ShardedScheduler::onPrepared(usize shard, const Transaction& branch)
+{
+  auto record = find(branch.id);
+  if (!record)
+    return;
+
+  auto& c = *record;
+  std::lock_guard lock(c.mutex);
+  if (c.phase != Phase::Preparing || c.branches[shard] != &branch || --c.inFlight)
+    return;
+
+  // todos certificaram: a partir daqui nenhum ramo pode ser abortado
+  c.phase = Phase::Finished;
+  c.tr->committed = true;
+  m_stats.commits++;
+  m_stats.distributedCommits++;
+  emit(c.current);
+
+  Task task { Task::Commit, nullptr, {}, c.current };
+  for (usize s = 0; s < c.branches.size(); s++)
+    if (c.branches[s])
+      task.branches.push_back({ s, c.branches[s] });
+  pendingTasks().push_back(std::move(task));
+
+  forget(c.tr->id);
+}
+
+void ShardedScheduler::drain()
+{
+  auto& tasks = pendingTasks();
+  auto& sends = sendBuffer();
+  while (!tasks.empty())
+  {
+    auto task = std::move(tasks.front());
+    tasks.pop_front();
+
+    switch (task.kind)
+    {
+      case Task::Next:
+      {
+        auto& c = *task.record;
+        {
+          std::lock_guard lock(c.mutex);
+          if (c.phase != Phase::Active || c.inFlight || c.queue.empty())
+            break;
+
+          auto op = c.queue.front();
+          c.queue.pop_front();
+          prepare(c, op, sends);
+        }
+        send(task.record, sends);
+        break;
+      }
+
+      case Task::Commit:
+        // o segundo commit de um ramo preparado só efetiva
+        for (auto [s, branch] : task.branches)
+          m_shards[s]->scheduler.schedule({ branch, task.op.type, task.op.res, task.op.obj });
+        break;
+
+      case Task::Abort:
+        for (auto [s, branch] : task.branches)
+        {
+          branch->ended = true;
+          m_shards[s]->scheduler.abort(branch);
+          m_shards[s]->scheduler.unpin();
+        }
+        break;
+    }
+  }
+}
+
+usize ShardedScheduler::tick()
+{
+  if (!m_pendingWaits)
+    return 0;
+
+  bool due;
+  {
+    std::lock_guard lock(m_detectionMutex);
+    bool byCount = m_detection.waitThreshold && m_pendingWaits >= m_detection.waitThreshold;
+    bool byTime =
+      m_detection.interval.count() &&
+      std::chrono::steady_clock::now() - m_lastDetection >= m_detection.interval;
+    due = byCount || byTime;
+  }
+  return due ? detectDeadlocks() : 0;
+}
+
+auto ShardedScheduler::threadState() -> ThreadState&
+{
+  // drain esvazia as tarefas antes de cada chamada retornar, então a entrada
+  // de uma instância destruída fica vazia e pode ser reaproveitada
+  thread_local std::unordered_map<const ShardedScheduler*, ThreadState> states;
+  return states[this];
+}
+
+} // namespace sgbd
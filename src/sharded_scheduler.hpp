@@ -0,0 +1,233 @@
+#pragma once
+
+#include "common.hpp"
+#include "scheduler.hpp"
+#include "table.hpp"
+#include "transaction.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace sgbd
+{
+
+/// @brief Coordena vários Scheduler independentes, cada um responsável por
+/// uma parte das tabelas.
+///
+/// Cada operação vai para o shard da sua tabela, onde a transação é
+/// representada por um ramo (uma Transaction do TransactionManager do shard,
+/// com o mesmo id e timestamp). Transações de shards diferentes não disputam
+/// nenhuma trava, então threads escalonando partições diferentes escalam de
+/// forma independente.
+///
+/// As operações de uma transação continuam sequenciais: uma operação só vai
+/// para um shard depois de a anterior ser emitida em todos os shards
+/// envolvidos. O commit de uma transação de um único shard é o commit normal;
+/// com vários, os ramos certificam (Transaction::twoPhase) e, quando todos
+/// estiverem preparados, o commit é emitido e os ramos efetivam. O abort de
+/// um ramo aborta todos os outros.
+///
+/// Os ciclos de espera entre shards não aparecem em nenhum grafo de espera
+/// isolado: detectDeadlocks junta as arestas de todos os shards e aborta a
+/// transação mais nova de cada ciclo. A detecção roda sozinha segundo
+/// Scheduler::Detection, contando as operações que ficaram em espera.
+class ShardedScheduler
+{
+ public:
+  /// @brief Como as tabelas são divididas entre os shards.
+  enum class Routing : ubyte
+  {
+    Area,  ///< Um shard por área; nenhum bloqueio cruza shards.
+    Table, ///< Tabelas divididas entre os shards; bloqueios de área vão para todos.
+  };
+
+  struct Stats
+  {
+    std::atomic<usize> emitted = 0;
+    std::atomic<usize> commits = 0;
+    std::atomic<usize> distributedCommits = 0; ///< Commits em duas fases.
+    std::atomic<usize> aborts = 0;
+    std::atomic<usize> globalDeadlocks = 0;    ///< Ciclos encontrados entre shards.
+    std::atomic<usize> detectionRuns = 0;
+  };
+
+ public:
+  /// @brief As tabelas existentes em rm são divididas, em ordem de nome,
+  /// entre os shards; tabelas criadas depois vão para o shard do hash do nome.
+  /// @param rm
+  /// @param shards Quantidade de shards (pelo menos 1).
+  /// @param routing
+  /// @param policy Política de deadlock de cada shard.
+  ShardedScheduler(ResourceManager& rm, usize shards, Routing routing = Routing::Area,
+    Scheduler::DeadlockPolicy policy = Scheduler::DeadlockPolicy::Detect);
+
+  ShardedScheduler(const ShardedScheduler&) = delete;
+  ShardedScheduler& operator=(const ShardedScheduler&) = delete;
+
+  // a configuração deve ser trocada sem threads escalonando
+  void setDetection(Scheduler::Detection detection) { m_detection = detection; }
+  const Scheduler::Detection& getDetection() const { return m_detection; }
+
+  /// @brief Destino das operações e abortos globais; Output::prepared não é
+  /// usado. Sem emit as operações ficam em getScheduling.
+  void setOutput(Scheduler::Output output) { m_output = std::move(output); }
+
+  usize getShardCount() const { return m_shards.size(); }
+  Scheduler& getShard(usize shard) { return m_shards[shard]->scheduler; }
+
+  /// @brief Shards que guardam os bloqueios da operação.
+  /// @param table
+  /// @param res Granulosidade; bloqueios de área com Routing::Table vão para
+  /// todos os shards.
+  auto shardsOf(const Table* table, Operation::Resource res) const -> std::pair<usize, usize>;
+
+  const Stats& getStats() const { return m_stats; }
+
+  /// @brief Soma dos bloqueios de todos os shards.
+  usize getLockCount() const;
+
+  /// @brief Cópia das operações globais emitidas, em ordem.
+  auto getScheduling() -> std::vector<Operation>;
+
+  /// @brief Encaminha a operação para o seu shard ou a coloca na fila da
+  /// transação. Pode ser chamado por várias threads.
+  /// @param op
+  void schedule(Operation op);
+
+  /// @brief Procura ciclos de espera dentro de cada shard e entre shards.
+  /// @return Quantidade de transações abortadas.
+  usize detectDeadlocks();
+
+  /// @brief Roda detectDeadlocks se um gatilho de Scheduler::Detection venceu.
+  /// Deve ser chamado a cada Scheduler::Detection::interval enquanto houver
+  /// operações em espera. Pode ser chamado por várias threads.
+  /// @return Quantidade de transações abortadas.
+  usize tick();
+
+ private:
+  struct Shard
+  {
+    TransactionManager branches;
+    Scheduler scheduler;
+
+    Shard(Scheduler::DeadlockPolicy policy) : scheduler(policy) {}
+  };
+
+  enum class Phase : ubyte
+  {
+    Active,     ///< Operações de leitura e escrita.
+    Committing, ///< Commit de um único shard enviado.
+    Preparing,  ///< Commit em duas fases esperando os ramos certificarem.
+    Finished,   ///< Efetivada ou abortada; os ramos são finalizados.
+  };
+
+  /// @brief Estado global de uma transação. Protegido por mutex.
+  struct Coordinated
+  {
+    std::mutex mutex;
+    Transaction* tr;
+    std::vector<Transaction*> branches; ///< Ramo em cada shard (nullptr se não usou).
+    std::deque<Operation> queue;        ///< Operações esperando a atual terminar.
+    Operation current { nullptr, Operation::Commit {}, Operation::Resource::Row };
+    usize inFlight = 0;                 ///< Shards que ainda não emitiram a atual.
+    Phase phase = Phase::Active;
+  };
+
+  using Record = std::shared_ptr<Coordinated>;
+
+  /// @brief Trabalho que chama os shards e por isso não pode ser feito nas
+  /// funções de Output; fica para o fim da chamada, em drain.
+  struct Task
+  {
+    enum Kind : ubyte { Next, Commit, Abort } kind;
+    Record record;                                        ///< Next.
+    std::vector<std::pair<usize, Transaction*>> branches; ///< Commit e Abort.
+
+    /// @brief Commit global, reenviado aos ramos preparados.
+    Operation op { nullptr, Operation::Commit {}, Operation::Resource::Row };
+  };
+
+  /// @brief Operação de cada ramo e o seu shard.
+  using Sends = std::vector<std::pair<usize, Operation>>;
+
+  /// @brief Tarefas e operações em envio de uma thread nesta instância.
+  struct ThreadState
+  {
+    std::deque<Task> tasks;
+    Sends sends;
+  };
+
+  static constexpr usize BucketCount = 64;
+
+  struct alignas(64) Bucket
+  {
+    std::mutex mutex;
+    std::unordered_map<usize, Record> records;
+  };
+
+ private:
+  auto bucketOf(usize id) -> Bucket& { return m_buckets[id % BucketCount]; }
+  auto find(usize id) -> Record;
+  auto findOrCreate(Transaction* tr) -> Record;
+  void forget(usize id);
+
+  /// @brief Torna op a operação atual e monta em sends a operação de cada
+  /// shard (com tr nulo onde ainda não há ramo). Requer Coordinated::mutex e
+  /// nenhuma operação em andamento.
+  void prepare(Coordinated& c, const Operation& op, Sends& sends);
+
+  /// @brief Cria os ramos que faltam e envia as operações de prepare. Chamado
+  /// sem Coordinated::mutex; inFlight impede outro prepare enquanto isso.
+  void send(const Record& record, Sends& sends);
+
+  /// @brief Decide o abort global e agenda o abort dos outros ramos, com pin
+  /// nos seus shards. Requer Coordinated::mutex.
+  /// @param except Shard cujo ramo já foi abortado (npos se nenhum).
+  /// @param reason
+  void abortLocked(Coordinated& c, usize except, AbortReason reason);
+
+  /// @brief Emite uma operação global. Requer Coordinated::mutex.
+  void emit(const Operation& op);
+
+  void onEmit(usize shard, const Operation& op);
+  void onAbort(usize shard, const Transaction& branch);
+  void onPrepared(usize shard, const Transaction& branch);
+
+  /// @brief Executa as tarefas agendadas pelas funções de Output até não
+  /// sobrar nenhuma.
+  void drain();
+
+  /// @brief Estado da thread atual nesta instância. O Output de uma instância
+  /// pode escalonar em outra, e cada uma só executa as próprias tarefas.
+  auto threadState() -> ThreadState&;
+  auto pendingTasks() -> std::deque<Task>& { return threadState().tasks; }
+  auto sendBuffer() -> Sends& { return threadState().sends; }
+
+ private:
+  std::vector<std::unique_ptr<Shard>> m_shards;
+  Routing m_routing;
+  std::unordered_map<const Table::Area*, usize> m_areaShards;
+  std::unordered_map<const Table*, usize> m_tableShards;
+
+  std::array<Bucket, BucketCount> m_buckets;
+
+  Scheduler::Output m_output;
+  std::mutex m_outputMutex;
+  std::vector<Operation> m_operations;
+
+  Scheduler::Detection m_detection;
+  std::mutex m_detectionMutex;
+  std::chrono::steady_clock::time_point m_lastDetection = std::chrono::steady_clock::now();
+  std::atomic<usize> m_pendingWaits = 0;
+
+  Stats m_stats;
+};
+
+} // namespace sgbd
@@ -1,37 +1,118 @@
 #include "table.hpp"
 
+#include <algorithm>
+#include <utility>
+
 namespace sgbd
 {
 
-void ResourceManager::createArea(const std::string &name)
+Table::Table(std::string name, Area *area)
+  : name(std::move(name)), area(area)
+{
+}
+
+usize Table::pageOf(usize row) const
+{
+  if (row < m_dense.size() && m_dense[row] != NoPage)
+    return m_dense[row];
+
+  auto it = m_sparse.find(row);
+  return it != m_sparse.end() ? it->second : npos;
+}
+
+void Table::insertRow(Row row, usize page)
+{
+  m_rows[makeRoom(page, 1)] = row.id;
+  index(row.id, page);
+}
+
+void Table::insertRows(std::span<const Row> rows, usize page)
+{
+  auto at = makeRoom(page, rows.size());
+  for (auto& row : rows)
+  {
+    m_rows[at++] = row.id;
+    index(row.id, page);
+  }
+}
+
+void Table::reserve(usize rows, usize pages)
+{
+  m_rows.reserve(rows);
+  m_pageStart.reserve(pages + 1);
+  m_dense.reserve(rows);
+}
+
+usize Table::makeRoom(usize page, usize count)
 {
-  m_areas.try_emplace(name, name);
+  if (page >= pageCount())
+    m_pageStart.resize(page + 2, m_rows.size());
+
+  // só as páginas seguintes se deslocam; na última página é um push_back
+  auto at = m_pageStart[page + 1];
+  m_rows.insert(m_rows.begin() + at, count, 0);
+  for (auto p = page + 1; p < m_pageStart.size(); p++)
+    m_pageStart[p] += count;
+  return at;
 }
 
-void ResourceManager::createTable(const std::string &name, const std::string &area)
+void Table::index(usize row, usize page)
 {
-  createArea(area);
-  m_tables.try_emplace(name, name, &m_areas[area]);
+  // ids até o dobro da quantidade de tuplas cabem no vetor sem desperdício
+  if (row < std::max<usize>(2 * m_rows.size(), 1024))
+  {
+    if (row >= m_dense.size())
+      m_dense.resize(row + 1, NoPage);
+    if (m_dense[row] == NoPage && pageOf(row) == npos)
+      m_dense[row] = uint(page);
+  }
+  else
+    m_sparse.try_emplace(row, uint(page));
 }
 
-void ResourceManager::insertRow(const std::string &table, const Table::Row &row, uint page)
+Table::Area* ResourceManager::createArea(std::string_view name)
 {
-  if (!m_tables.contains(table))
-    return;
+  if (auto area = getArea(name))
+    return area;
+  return &m_areas.emplace(name, Table::Area { std::string(name) }).first->second;
+}
 
-  auto& tab = m_tables[table];
+Table* ResourceManager::createTable(std::string_view name, std::string_view area)
+{
+  auto a = createArea(area);
+  if (auto table = getTable(name))
+    return table;
+  return &m_tables.emplace(name, Table(std::string(name), a)).first->second;
+}
 
-  if (page >= tab.pages.size())
-    tab.pages.resize(page + 1);
+void ResourceManager::insertRow(std::string_view table, const Table::Row &row, uint page)
+{
+  if (auto tab = getTable(table))
+    tab->insertRow(row, page);
+}
 
-  tab.pages[page].rows.emplace_back(row);
+void ResourceManager::insertRows(std::string_view table, std::span<const Table::Row> rows, uint page)
+{
+  if (auto tab = getTable(table))
+    tab->insertRows(rows, page);
+}
+
+void ResourceManager::reserve(usize areas, usize tables)
+{
+  m_areas.reserve(m_areas.size() + areas);
+  m_tables.reserve(m_tables.size() + tables);
+}
+
+Table *ResourceManager::getTable(std::string_view name)
+{
+  auto it = m_tables.find(name);
+  return it != m_tables.end() ? &it->second : nullptr;
 }
 
-Table *ResourceManager::getTable(const std::string &name)
+Table::Area *ResourceManager::getArea(std::string_view name)
 {
-  if (m_tables.contains(name))
-    return &m_tables[name];
-  return nullptr;
+  auto it = m_areas.find(name);
+  return it != m_areas.end() ? &it->second : nullptr;
 }
 
 } // namespace sgbd
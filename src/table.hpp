@@ -2,14 +2,22 @@
 
 #include "common.hpp"
 
+#include <functional>
+#include <span>
 #include <unordered_map>
 #include <vector>
 #include <string>
+#include <string_view>
 
 namespace sgbd
 {
 
 /// @brief Modelo de tabela de banco de dados.
+///
+/// As tuplas ficam em uma única coluna contínua, agrupadas por página: as
+/// tuplas da página p ocupam [pageStart[p], pageStart[p + 1]). Um índice de
+/// id para página resolve pageOf em O(1), direto em um vetor para ids densos
+/// e em um mapa para ids esparsos.
 struct Table
 {
   struct Area
@@ -22,43 +30,132 @@ struct Table
     usize id;
   };
 
-  struct Page
-  {
-    std::vector<Row> rows;
-  };
-
   std::string name;
   Area* area;
-  std::vector<Page> pages;
+
+ public:
+  Table(std::string name, Area* area);
+
+  /// @brief Busca a página que contém a tupla.
+  /// @param row ID da tupla.
+  /// @return Índice da página ou npos se a tupla não existir.
+  usize pageOf(usize row) const;
+
+  /// @brief Insere uma tupla no fim de uma página, criando as páginas que
+  /// faltarem. Inserir na última página custa O(1) amortizado.
+  /// @param row Tupla.
+  /// @param page Página.
+  void insertRow(Row row, usize page);
+
+  /// @brief Insere várias tuplas no fim de uma página com um único
+  /// deslocamento da coluna.
+  /// @param rows Tuplas.
+  /// @param page Página.
+  void insertRows(std::span<const Row> rows, usize page);
+
+  /// @brief Reserva espaço para as tuplas e páginas de uma carga.
+  void reserve(usize rows, usize pages);
+
+  usize pageCount() const { return m_pageStart.size() - 1; }
+  usize rowCount() const { return m_rows.size(); }
+
+  /// @brief IDs das tuplas de todas as páginas, página a página.
+  auto rows() const -> std::span<const usize> { return m_rows; }
+
+  /// @brief IDs das tuplas de uma página.
+  /// @param page Página (< pageCount()).
+  auto rowsOf(usize page) const -> std::span<const usize>
+  {
+    return std::span(m_rows).subspan(m_pageStart[page], m_pageStart[page + 1] - m_pageStart[page]);
+  }
+
+ private:
+  static constexpr uint NoPage = uint(-1);
+
+  /// @brief Desloca a coluna para abrir `count` posições no fim da página.
+  /// @return Posição da primeira tupla nova.
+  usize makeRoom(usize page, usize count);
+
+  /// @brief Registra a página da tupla; a primeira inserção de um id vence.
+  void index(usize row, usize page);
+
+ private:
+  std::vector<usize> m_rows;
+  std::vector<usize> m_pageStart {0};
+
+  std::vector<uint> m_dense;                  ///< id -> página, ids pequenos.
+  std::unordered_map<usize, uint> m_sparse;   ///< id -> página, os demais.
+};
+
+/// @brief Hash de nomes que aceita std::string_view sem construir uma
+/// std::string.
+struct NameHash
+{
+  using is_transparent = void;
+
+  usize operator()(std::string_view name) const { return std::hash<std::string_view>()(name); }
 };
 
 /// @brief Gerencia as tabelas do banco de dados.
+///
+/// Tabelas e áreas nunca mudam de endereço depois de criadas, então os
+/// ponteiros retornados servem de identificadores internados: o nome é
+/// resolvido uma vez e o resto do sistema compara ponteiros.
 class ResourceManager
 {
  public:
   /// @brief Cria uma área se ja não existir.
   /// @param name Nome da área.
-  void createArea(const std::string& name);
+  /// @return Ponteiro para a área.
+  Table::Area* createArea(std::string_view name);
 
   /// @brief Cria uma tabela se já não existir.
   /// @param name Nome da tabela.
   /// @param area Nome da área (cria a área se não existir).
-  void createTable(const std::string& name, const std::string& area);
+  /// @return Ponteiro para a tabela.
+  Table* createTable(std::string_view name, std::string_view area);
 
   /// @brief Insere uma tupla na tabela em uma página específica.
   /// @param table Nome da tabela.
   /// @param row Tupla.
   /// @param page Página.
-  void insertRow(const std::string& table, const Table::Row& row, uint page = 0);
+  void insertRow(std::string_view table, const Table::Row& row, uint page = 0);
 
-  /// @brief Busca um ponteiro para a tabela se existir.
+  /// @brief Insere várias tuplas na tabela em uma página específica.
+  /// @param table Nome da tabela.
+  /// @param rows Tuplas.
+  /// @param page Página.
+  void insertRows(std::string_view table, std::span<const Table::Row> rows, uint page = 0);
+
+  /// @brief Dimensiona os mapas para que criar até essa quantidade de áreas
+  /// e tabelas não cause rehash.
+  void reserve(usize areas, usize tables);
+
+  /// @brief Busca um ponteiro para a tabela se existir, sem alocar.
   /// @param name Nome da tabela.
   /// @return Ponteiro para a tabela ou nullptr se não existir.
-  Table* getTable(const std::string& name);
+  Table* getTable(std::string_view name);
+
+  /// @brief Visita todas as tabelas, em ordem qualquer.
+  /// @param fn Função (Table&).
+  template <class Fn>
+  void forEachTable(Fn&& fn)
+  {
+    for (auto& [name, table] : m_tables)
+      fn(table);
+  }
+
+  /// @brief Busca um ponteiro para a área se existir, sem alocar.
+  /// @param name Nome da área.
+  /// @return Ponteiro para a área ou nullptr se não existir.
+  Table::Area* getArea(std::string_view name);
 
  private:
-  std::unordered_map<std::string, Table::Area> m_areas;
-  std::unordered_map<std::string, Table> m_tables;
+  template <class T>
+  using NameMap = std::unordered_map<std::string, T, NameHash, std::equal_to<>>;
+
+  NameMap<Table::Area> m_areas;
+  NameMap<Table> m_tables;
 };
 
 } // namespace sgbd
@@ -0,0 +1,74 @@
+#include "timestamp_oracle.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+namespace sgbd
+{
+
+static std::atomic<std::uint64_t> s_instances = 0;
+
+TimestampOracle::TimestampOracle(Mode mode, usize batchSize)
+  : m_mode(mode), m_batchSize(std::max<usize>(batchSize, 1)), m_instance(++s_instances)
+{
+}
+
+usize TimestampOracle::next()
+{
+  switch (m_mode)
+  {
+    case Mode::Counter:
+      return m_clock.fetch_add(1, std::memory_order_relaxed) + 1;
+
+    case Mode::Batched:
+    {
+      // um bloco por thread; alternar entre oracles descarta o resto do bloco
+      struct Block
+      {
+        std::uint64_t instance = 0;
+        usize next = 0;
+        usize end = 0;
+      };
+      thread_local Block block;
+
+      if (block.instance != m_instance || block.next == block.end)
+      {
+        block.instance = m_instance;
+        block.next = m_clock.fetch_add(m_batchSize, std::memory_order_relaxed) + 1;
+        block.end = block.next + m_batchSize;
+      }
+      return block.next++;
+    }
+
+    default:
+      return nextHybrid();
+  }
+}
+
+void TimestampOracle::observe(usize remote)
+{
+  if (m_mode != Mode::Hybrid)
+    return;
+
+  auto clock = m_clock.load(std::memory_order_relaxed);
+  while (clock < remote && !m_clock.compare_exchange_weak(clock, remote, std::memory_order_relaxed)) {}
+}
+
+auto TimestampOracle::nextHybrid() -> usize
+{
+  auto now = std::chrono::duration_cast<std::chrono::milliseconds>(
+    std::chrono::system_clock::now().time_since_epoch());
+  auto physical = usize(now.count()) << LogicalBits;
+
+  // o contador lógico transborda para o tempo físico sem perder a ordem
+  auto clock = m_clock.load(std::memory_order_relaxed);
+  usize ts;
+  do
+  {
+    ts = std::max(clock + 1, physical);
+  }
+  while (!m_clock.compare_exchange_weak(clock, ts, std::memory_order_relaxed));
+  return ts;
+}
+
+} // namespace sgbd
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <atomic>
+#include <cstdint>
+
+namespace sgbd
+{
+
+/// @brief Fonte de timestamps das transações. Pode ser usada por várias
+/// threads e dividida entre vários TransactionManager (e.g. um por shard).
+///
+/// Todo timestamp devolvido é único e maior que zero; wait-die e wound-wait
+/// só precisam dessa ordem total para decidir quem é a mais velha.
+class TimestampOracle
+{
+ public:
+  enum class Mode : ubyte
+  {
+    Counter, ///< Contador atômico: a ordem dos timestamps é a ordem de registro.
+    Batched, ///< Cada thread reserva blocos do contador e os consome sem disputa.
+    Hybrid,  ///< Relógio lógico híbrido: tempo físico em ms com contador lógico.
+  };
+
+ public:
+  TimestampOracle(Mode mode = Mode::Counter, usize batchSize = 64);
+
+  /// @brief Próximo timestamp.
+  usize next();
+
+  /// @brief Avança o relógio para depois de um timestamp recebido de outro
+  /// oracle, de modo que os próximos sejam maiores que ele. Só tem efeito no
+  /// modo Hybrid.
+  /// @param remote
+  void observe(usize remote);
+
+  Mode getMode() const { return m_mode; }
+  usize getBatchSize() const { return m_batchSize; }
+
+ private:
+  /// Bits do contador lógico no modo Hybrid.
+  static constexpr uint LogicalBits = 16;
+
+  auto nextHybrid() -> usize;
+
+ private:
+  Mode m_mode;
+  usize m_batchSize;
+  std::atomic<usize> m_clock = 0;
+
+  /// Identifica o oracle nos blocos reservados por thread, já que outro
+  /// oracle pode ocupar o mesmo endereço depois deste.
+  std::uint64_t m_instance;
+};
+
+} // namespace sgbd
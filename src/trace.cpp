@@ -0,0 +1,224 @@
+#include "trace.hpp"
+
+#include "operation_log.hpp"
+#include "operation_parser.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace sgbd
+{
+
+MappedFile::~MappedFile()
+{
+  close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::string& path)
+{
+  close();
+
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+    OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+    return false;
+
+  LARGE_INTEGER size;
+  bool ok = GetFileSizeEx(file, &size);
+  if (ok && size.QuadPart > 0)
+  {
+    ok = false;
+    if (HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr))
+    {
+      // a vista mantém o arquivo mapeado depois de fechar os handles
+      if (void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0))
+      {
+        m_data = static_cast<const char*>(data);
+        m_size = usize(size.QuadPart);
+        ok = true;
+      }
+      CloseHandle(mapping);
+    }
+  }
+
+  CloseHandle(file);
+  return ok;
+}
+
+void MappedFile::close()
+{
+  if (m_data)
+    UnmapViewOfFile(m_data);
+  m_data = nullptr;
+  m_size = 0;
+}
+
+#else
+
+bool MappedFile::open(const std::string& path)
+{
+  close();
+
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat st;
+  if (fstat(fd, &st) < 0)
+  {
+    ::close(fd);
+    return false;
+  }
+
+  // mmap não aceita tamanho 0; um arquivo vazio é um trace vazio
+  if (st.st_size > 0)
+  {
+    void* data = mmap(nullptr, usize(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED)
+    {
+      ::close(fd);
+      return false;
+    }
+    madvise(data, usize(st.st_size), MADV_SEQUENTIAL);
+    m_data = static_cast<const char*>(data);
+    m_size = usize(st.st_size);
+  }
+
+  ::close(fd);
+  return true;
+}
+
+void MappedFile::close()
+{
+  if (m_data)
+    munmap(const_cast<char*>(m_data), m_size);
+  m_data = nullptr;
+  m_size = 0;
+}
+
+#endif
+
+TraceReplay::TraceReplay(ResourceManager& rm, TransactionManager& tm, Scheduler& scheduler)
+  : m_resManager(rm), m_trManager(tm), m_scheduler(scheduler) {}
+
+auto TraceReplay::run(std::string_view trace) -> Stats
+{
+  Stats stats;
+
+  // os ids só viram transações na hora de escalonar: uma transação terminada
+  // pode ter o slot reciclado, e o mesmo id lido depois é outra transação
+  struct Parsed
+  {
+    usize trid;
+    Operation op;
+  };
+
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::deque<std::vector<Parsed>> queue;
+  bool done = false;
+
+  std::thread parser([&]
+  {
+    usize chunks = 0, invalid = 0;
+
+    auto read = [&](auto& source, usize limit)
+    {
+      std::vector<Parsed> batch;
+      while (batch.size() < limit && source.hasNext())
+      {
+        usize trid;
+        if (auto op = source.nextUnresolved(trid))
+          batch.push_back({ trid, *op });
+        else
+          invalid++;
+      }
+      chunks++;
+
+      std::unique_lock lock(mutex);
+      changed.wait(lock, [&] { return queue.size() < QueueDepth; });
+      queue.push_back(std::move(batch));
+      changed.notify_all();
+    };
+
+    if (OperationLogReader::isOperationLog(trace))
+    {
+      OperationLogReader reader(trace, m_resManager, m_trManager);
+      while (reader.hasNext())
+        read(reader, BatchSize);
+    }
+    else
+    {
+      for (usize at = 0; at < trace.size();)
+      {
+        auto chunk = nextChunk(trace, at);
+        if (chunk.empty())
+          continue;
+
+        OperationParser parser(chunk, m_resManager, m_trManager);
+        read(parser, npos);
+      }
+    }
+
+    std::lock_guard lock(mutex);
+    stats.chunks = chunks;
+    stats.invalid = invalid;
+    done = true;
+    changed.notify_all();
+  });
+
+  for (;;)
+  {
+    std::vector<Parsed> batch;
+    {
+      std::unique_lock lock(mutex);
+      changed.wait(lock, [&] { return !queue.empty() || done; });
+      if (queue.empty())
+        break;
+      batch = std::move(queue.front());
+      queue.pop_front();
+      changed.notify_all();
+    }
+
+    for (auto& [trid, op] : batch)
+    {
+      op.tr = m_trManager.registerTransaction(trid);
+      if (m_recorder)
+        m_recorder->write(op);
+      m_scheduler.schedule(op);
+    }
+    stats.operations += batch.size();
+  }
+
+  parser.join();
+  return stats;
+}
+
+auto TraceReplay::nextChunk(std::string_view trace, usize& at) const -> std::string_view
+{
+  auto begin = at;
+  auto end = begin + m_chunkSize < trace.size() ? trace.find('\n', begin + m_chunkSize) : npos;
+  at = end == npos ? trace.size() : end + 1;
+
+  // espaços no fim fariam o analisador ler um Eof como operação inválida
+  auto chunk = trace.substr(begin, at - begin);
+  auto last = chunk.find_last_not_of(" \t\r\n");
+  return last == npos ? std::string_view() : chunk.substr(0, last + 1);
+}
+
+} // namespace sgbd
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "common.hpp"
+#include "operation_log.hpp"
+#include "scheduler.hpp"
+#include "table.hpp"
+#include "transaction.hpp"
+
+#include <string>
+#include <string_view>
+
+namespace sgbd
+{
+
+/// @brief Arquivo somente leitura mapeado em memória.
+class MappedFile
+{
+ public:
+  MappedFile() = default;
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  /// @brief Mapeia o arquivo inteiro, desfazendo um mapeamento anterior.
+  /// @param path Caminho do arquivo.
+  /// @return false se o arquivo não pôde ser aberto ou mapeado.
+  bool open(const std::string& path);
+  void close();
+
+  auto view() const -> std::string_view { return { m_data, m_size }; }
+
+ private:
+  const char* m_data = nullptr;
+  usize m_size = 0;
+};
+
+/// @brief Reproduz um trace de operações no escalonador.
+///
+/// O trace é um log binário (OperationLogReader) ou texto com a mesma sintaxe
+/// do terminal, dividido em blocos terminados em fim de linha (uma operação
+/// não pode ocupar duas linhas). Uma thread lê os blocos direto da memória do
+/// trace, sem copiar linhas, enquanto a thread que chamou run escalona as
+/// operações já lidas, na ordem do arquivo.
+class TraceReplay
+{
+ public:
+  struct Stats
+  {
+    usize chunks = 0;     ///< Blocos de texto ou lotes do log binário.
+    usize operations = 0; ///< Operações enviadas ao escalonador.
+    usize invalid = 0;    ///< Trechos inválidos descartados pelo analisador.
+  };
+
+ public:
+  TraceReplay(ResourceManager& rm, TransactionManager& tm, Scheduler& scheduler);
+
+  /// @brief Tamanho aproximado de cada bloco (o bloco vai até o fim da linha).
+  void setChunkSize(usize size) { m_chunkSize = size ? size : 1; }
+
+  /// @brief Grava cada operação lida, antes de escaloná-la (nullptr desativa).
+  void setRecorder(OperationLogWriter* recorder) { m_recorder = recorder; }
+
+  /// @brief Escalona todas as operações do trace. O escalonamento emitido
+  /// sai pela Scheduler::Output configurada.
+  /// @param trace Conteúdo do trace; precisa durar até o retorno.
+  auto run(std::string_view trace) -> Stats;
+
+ private:
+  /// @brief Próximo bloco do trace a partir de `at`, terminado em fim de linha.
+  auto nextChunk(std::string_view trace, usize& at) const -> std::string_view;
+
+ private:
+  static constexpr usize QueueDepth = 4;
+  static constexpr usize BatchSize = 4096; ///< Operações por bloco do log binário.
+
+  ResourceManager& m_resManager;
+  TransactionManager& m_trManager;
+  Scheduler& m_scheduler;
+  usize m_chunkSize = usize(1) << 20;
+  OperationLogWriter* m_recorder = nullptr;
+};
+
+} // namespace sgbd
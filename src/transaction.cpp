@@ -3,16 +3,93 @@
 namespace sgbd
 {
 
-usize TransactionManager::s_currentTimestamp = 0;
-
 Transaction *TransactionManager::registerTransaction(usize id)
 {
-  return &m_transactions.try_emplace(id, id, s_currentTimestamp++).first->second;
+  std::lock_guard lock(m_mutex);
+  auto it = m_index.find(id);
+  if (it != m_index.end())
+  {
+    auto& tr = m_slabs[it->second / SlabSize][it->second % SlabSize];
+    if (!tr.settled)
+      return &tr;
+
+    // o id de uma transação terminada volta a ser uma transação nova; o slot
+    // antigo sai do índice e continua ocupado até ser liberado
+    m_indexPool.erase(m_index, it);
+  }
+
+  uint slot;
+  if (!m_free.empty())
+  {
+    slot = m_free.back();
+    m_free.pop_back();
+  }
+  else
+  {
+    if (m_slots % SlabSize == 0)
+      m_slabs.push_back(std::make_unique<Transaction[]>(SlabSize));
+    slot = uint(m_slots++);
+    m_used.push_back(false);
+  }
+  m_used[slot] = true;
+  m_indexPool.insert(m_index, id, [slot](uint& s) { s = slot; });
+
+  // um ponteiro antigo para um slot reciclado ainda pode ser usado por uma
+  // thread que acorda a transação; ela vê o slot antes ou depois de limpo
+  auto& tr = m_slabs[slot / SlabSize][slot % SlabSize];
+  std::lock_guard trLock(tr.mutex);
+  tr.id = id;
+  tr.timestamp = m_oracle->next();
+  tr.aborted = false;
+  tr.committed = false;
+  tr.ended = false;
+  tr.retired = false;
+  tr.settled = false;
+  tr.twoPhase = false;
+  tr.prepared = false;
+  tr.abortReason = AbortReason::None;
+  tr.waiting.clear();
+  tr.slot = slot;
+  return &tr;
 }
 
 Transaction *TransactionManager::get(usize id)
 {
-  return m_transactions.contains(id) ? &m_transactions[id] : nullptr;
+  std::lock_guard lock(m_mutex);
+  auto it = m_index.find(id);
+  return it != m_index.end() ? &m_slabs[it->second / SlabSize][it->second % SlabSize] : nullptr;
+}
+
+void TransactionManager::release(Transaction *tr)
+{
+  std::lock_guard lock(m_mutex);
+  if (!m_used[tr->slot])
+    return;
+
+  // o id pode já apontar para uma transação nova em outro slot
+  auto it = m_index.find(tr->id);
+  if (it != m_index.end() && it->second == tr->slot)
+    m_indexPool.erase(m_index, it);
+  m_used[tr->slot] = false;
+  m_free.push_back(tr->slot);
+}
+
+usize TransactionManager::size()
+{
+  std::lock_guard lock(m_mutex);
+  return m_index.size();
+}
+
+usize TransactionManager::capacity()
+{
+  std::lock_guard lock(m_mutex);
+  return m_slots;
+}
+
+void TransactionManager::setTimestampOracle(TimestampOracle *oracle)
+{
+  std::lock_guard lock(m_mutex);
+  m_oracle = oracle ? oracle : &m_ownOracle;
 }
 
 } // namespace sgbd
@@ -1,25 +1,21 @@
 #pragma once
 
 #include "common.hpp"
+#include "node_pool.hpp"
 #include "table.hpp"
+#include "timestamp_oracle.hpp"
 
 #include <unordered_map>
 #include <variant>
-#include <list>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
 
 namespace sgbd
 {
 
-struct Operation;
-
-/// @brief Informações de uma transação.
-struct Transaction
-{
-  usize id;
-  usize timestamp;
-  bool aborted = false;
-  std::list<Operation> waiting;
-};
+struct Transaction;
 
 /// @brief Operação de uma transação.
 struct Operation
@@ -57,13 +53,85 @@ struct Operation
   Transaction* tr;
   Type type;
   Resource res;
+  usize obj = npos; ///< Tupla ou página alvo (npos para a tabela inteira).
+};
+
+/// @brief Fila das operações em espera de uma transação. Mantém a
+/// capacidade quando esvazia, então um slot de transação reciclado não volta
+/// a alocar.
+class OperationQueue
+{
+ public:
+  bool empty() const { return m_head == m_ops.size(); }
+  usize size() const { return m_ops.size() - m_head; }
+
+  Operation& front() { return m_ops[m_head]; }
+  void push_back(const Operation& op) { m_ops.push_back(op); }
+
+  void pop_front()
+  {
+    if (++m_head == m_ops.size())
+      clear();
+  }
+
+  void clear()
+  {
+    m_ops.clear();
+    m_head = 0;
+  }
+
+ private:
+  std::vector<Operation> m_ops;
+  usize m_head = 0;
+};
+
+/// @brief Motivo do abort de uma transação.
+enum class AbortReason : ubyte
+{
+  None,
+  Deadlock, ///< Vítima de um ciclo de espera.
+  Died,     ///< Wait-die: a mais nova pediu um bloqueio de uma mais velha.
+  Wounded,  ///< Wound-wait: ferida por uma mais velha.
+  NoWait,   ///< No-wait: o bloqueio não estava livre.
+  External, ///< Scheduler::abort (e.g. outro shard abortou a transação).
+};
+
+/// @brief Informações de uma transação.
+///
+/// `mutex` serializa as operações da transação e protege `waiting` e os seus
+/// bloqueios; as flags atômicas podem ser lidas por qualquer thread.
+struct Transaction
+{
+  usize id = 0;
+  usize timestamp = 0;
+  std::atomic<bool> aborted = false;
+  std::atomic<bool> committed = false;
+  std::atomic<bool> ended = false;   ///< O commit da transação já chegou ao escalonador.
+  std::atomic<bool> retired = false; ///< Já devolvida ao TransactionManager.
+  /// Terminada e sem bloqueios, nó no grafo ou contagens no escalonador; só
+  /// então o id pode ser registrado de novo.
+  std::atomic<bool> settled = false;
+  std::atomic<bool> twoPhase = false; ///< O commit só certifica e espera um segundo commit.
+  std::atomic<bool> prepared = false; ///< Certificada no commit em duas fases.
+  std::atomic<AbortReason> abortReason = AbortReason::None; ///< Escrito antes de `aborted`.
+  OperationQueue waiting;
+  std::mutex mutex;
+  uint slot = 0; ///< Posição fixa no TransactionManager.
 };
 
-/// @brief Gerenciador de transações.
+/// @brief Gerenciador de transações. Pode ser usado por várias threads.
+///
+/// As transações ficam em blocos de SlabSize slots que nunca mudam de
+/// endereço; Transaction::slot é um índice denso e os slots liberados vão
+/// para uma lista livre, reaproveitada antes de criar slots novos.
 class TransactionManager
 {
  public:
-  /// @brief Registra uma nova transação se não existir.
+  /// @brief Registra uma nova transação se não existir. Se a transação do id
+  /// já terminou e o escalonador liberou tudo o que era dela
+  /// (Transaction::settled), o id volta a ser uma transação nova; antes
+  /// disso, os donos de bloqueios e os nós do grafo, identificados pelo id,
+  /// ainda seriam confundidos com os dela.
   /// @param id
   Transaction* registerTransaction(usize id);
 
@@ -72,11 +140,37 @@ class TransactionManager
   /// @return Ponteiro para a transação ou nullptr se não existir.
   Transaction* get(usize id);
 
- private:
-  std::unordered_map<usize, Transaction> m_transactions;
+  /// @brief Devolve o slot da transação para a lista livre em O(1). Nenhum
+  /// bloqueio, operação ou thread pode continuar usando o ponteiro; o mesmo
+  /// id volta a ser uma transação nova.
+  /// @param tr
+  void release(Transaction* tr);
+
+  /// @brief Ids registrados e não liberados.
+  usize size();
+
+  /// @brief Slots já criados (registradas + livres).
+  usize capacity();
+
+  /// @brief Troca a fonte de timestamps das próximas transações; gerenciadores
+  /// que escalonam as mesmas transações devem dividir o mesmo oracle.
+  /// @param oracle Oracle compartilhado ou nullptr para voltar ao próprio.
+  void setTimestampOracle(TimestampOracle* oracle);
+  TimestampOracle& getTimestampOracle() { return *m_oracle; }
 
  private:
-  static usize s_currentTimestamp;
+  static constexpr usize SlabSize = 256;
+
+  std::mutex m_mutex;
+  std::vector<std::unique_ptr<Transaction[]>> m_slabs;
+  std::vector<uint> m_free;
+  std::vector<bool> m_used; ///< slot -> ocupado (registrado e não liberado)
+  std::unordered_map<usize, uint> m_index; ///< id -> slot
+  NodePool<std::unordered_map<usize, uint>> m_indexPool;
+  usize m_slots = 0;
+
+  TimestampOracle m_ownOracle;
+  TimestampOracle* m_oracle = &m_ownOracle;
 };
 
 } // namespace sgbd
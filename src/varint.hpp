@@ -0,0 +1,39 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace sgbd
+{
+
+/// @brief Acrescenta value em varint (LEB128): 7 bits por byte, do menos
+/// significativo, com o bit 7 ligado em todos menos o último.
+inline void putVarint(std::string& buffer, usize value)
+{
+  while (value >= 0x80)
+  {
+    buffer += char(value | 0x80);
+    value >>= 7;
+  }
+  buffer += char(value);
+}
+
+/// @brief Lê um varint de src a partir de at, que avança até o fim dele.
+/// @return O valor ou vazio se src terminar antes (ou passar de 64 bits).
+inline auto getVarint(std::string_view src, usize& at) -> std::optional<usize>
+{
+  usize value = 0;
+  for (uint shift = 0; at < src.size() && shift < 64; shift += 7)
+  {
+    ubyte b = ubyte(src[at++]);
+    value |= usize(b & 0x7f) << shift;
+    if (!(b & 0x80))
+      return value;
+  }
+  return {};
+}
+
+} // namespace sgbd
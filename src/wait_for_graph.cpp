@@ -1,52 +1,322 @@
 #include "wait_for_graph.hpp"
 
+#include <algorithm>
+
 namespace sgbd
 {
 
-bool WaitForGraph::add(usize ti, usize tj)
+bool WaitForGraph::add(usize ti, usize tj, std::vector<usize>* cycle)
 {
-  if (hasCycle(tj, ti))
+  if (ti == tj)
+  {
+    if (cycle) *cycle = { ti };
     return false;
+  }
+
+  if (!m_ordered)
+    rebuildOrder();
+
+  auto si = node(ti, true);
+  auto sj = node(tj, false);
+  auto& out = m_nodes[si].out;
+  if (std::find(out.begin(), out.end(), sj) != out.end())
+    return true;
 
-  m_nodes[ti].emplace(tj);
-  m_nodes.try_emplace(tj);
+  // a ordem só precisa ser corrigida se tj vem antes de ti
+  if (m_nodes[sj].ord < m_nodes[si].ord)
+  {
+    m_epoch++;
+    if (searchForward(sj, m_nodes[si].ord, si, cycle))
+      return false;
+
+    searchBackward(si, m_nodes[sj].ord);
+    reorder();
+  }
+
+  m_nodes[si].out.push_back(sj);
+  m_nodes[sj].in.push_back(si);
   return true;
 }
 
-auto WaitForGraph::remove(usize tr) -> std::unordered_set<usize>
+void WaitForGraph::link(usize ti, usize tj)
 {
-  std::unordered_set<usize> waiting;
-  m_nodes.erase(tr);
-  for (auto& node : m_nodes)
-    if (node.second.erase(tr))
-      waiting.insert(node.first);
+  auto si = node(ti, true);
+  auto sj = node(tj, false);
+  auto& out = m_nodes[si].out;
+  if (ti == tj || std::find(out.begin(), out.end(), sj) != out.end())
+    return;
 
-  return waiting;
+  m_nodes[si].out.push_back(sj);
+  m_nodes[sj].in.push_back(si);
+  m_ordered = false;
 }
 
-bool WaitForGraph::waitsFor(usize ti, usize tj)
+auto WaitForGraph::findCycles() -> std::vector<std::vector<usize>>
 {
-  return m_nodes.contains(ti) && m_nodes[ti].contains(tj);
+  std::vector<std::vector<usize>> cycles;
+  std::vector<usize> index(m_nodes.size(), npos), low(m_nodes.size());
+  std::vector<bool> onStack(m_nodes.size(), false);
+  std::vector<std::pair<Slot, usize>> frames;
+  usize counter = 0;
+
+  auto visit = [&](Slot slot)
+  {
+    index[slot] = low[slot] = counter++;
+    m_stack.push_back(slot);
+    onStack[slot] = true;
+    frames.push_back({ slot, 0 });
+  };
+
+  m_stack.clear();
+  for (auto& [tr, root] : m_index)
+  {
+    if (index[root] != npos)
+      continue;
+
+    visit(root);
+    while (!frames.empty())
+    {
+      auto [slot, edge] = frames.back();
+      auto& out = m_nodes[slot].out;
+
+      if (edge < out.size())
+      {
+        frames.back().second++;
+        auto next = out[edge];
+        if (index[next] == npos) visit(next);
+        else if (onStack[next]) low[slot] = std::min(low[slot], index[next]);
+        continue;
+      }
+
+      frames.pop_back();
+      if (!frames.empty())
+      {
+        auto parent = frames.back().first;
+        low[parent] = std::min(low[parent], low[slot]);
+      }
+
+      if (low[slot] != index[slot])
+        continue;
+
+      std::vector<usize> component;
+      Slot member;
+      do
+      {
+        member = m_stack.back();
+        m_stack.pop_back();
+        onStack[member] = false;
+        component.push_back(m_nodes[member].tr);
+      } while (member != slot);
+
+      if (component.size() > 1)
+        cycles.push_back(std::move(component));
+    }
+  }
+  return cycles;
 }
 
-bool WaitForGraph::waitsForAny(usize tr)
+auto WaitForGraph::remove(usize tr) -> std::vector<usize>
 {
-  return m_nodes.contains(tr) && !m_nodes[tr].empty();
+  std::vector<usize> waiting;
+  auto it = m_index.find(tr);
+  if (it == m_index.end())
+    return waiting;
+
+  auto slot = it->second;
+  auto& n = m_nodes[slot];
+
+  for (auto next : n.out)
+    unlink(m_nodes[next].in, slot);
+
+  for (auto prev : n.in)
+  {
+    unlink(m_nodes[prev].out, slot);
+    waiting.push_back(m_nodes[prev].tr);
+  }
+
+  n.out.clear();
+  n.in.clear();
+  m_free.push_back(slot);
+  m_index.erase(it);
+  return waiting;
 }
 
-bool WaitForGraph::hasCycle(usize start, usize end)
+void WaitForGraph::clearOut(usize tr)
 {
-  if (start == end || waitsFor(start, end))
-    return true;
+  auto slot = find(tr);
+  if (slot == NoSlot)
+    return;
+
+  // remover arestas não invalida a ordem topológica
+  for (auto next : m_nodes[slot].out)
+    unlink(m_nodes[next].in, slot);
+  m_nodes[slot].out.clear();
+}
 
-  if (m_nodes.contains(start) && m_nodes[start].empty())
+bool WaitForGraph::waitsFor(usize ti, usize tj) const
+{
+  auto si = find(ti), sj = find(tj);
+  if (si == NoSlot || sj == NoSlot)
     return false;
 
-  for (auto& tr : m_nodes[start])
-    if (hasCycle(tr, end))
-      return true;
+  auto& out = m_nodes[si].out;
+  return std::find(out.begin(), out.end(), sj) != out.end();
+}
+
+bool WaitForGraph::waitsForAny(usize tr) const
+{
+  auto slot = find(tr);
+  return slot != NoSlot && !m_nodes[slot].out.empty();
+}
+
+auto WaitForGraph::node(usize tr, bool front) -> Slot
+{
+  auto [it, inserted] = m_index.try_emplace(tr, NoSlot);
+  if (!inserted)
+    return it->second;
 
+  if (!m_free.empty())
+  {
+    it->second = m_free.back();
+    m_free.pop_back();
+  }
+  else
+  {
+    it->second = Slot(m_nodes.size());
+    m_nodes.emplace_back();
+  }
+
+  auto& n = m_nodes[it->second];
+  n.tr = tr;
+  n.ord = front ? m_frontOrd-- : m_backOrd++;
+  return it->second;
+}
+
+auto WaitForGraph::find(usize tr) const -> Slot
+{
+  auto it = m_index.find(tr);
+  return it != m_index.end() ? it->second : NoSlot;
+}
+
+bool WaitForGraph::searchForward(Slot start, usize ub, Slot target, std::vector<usize>* cycle)
+{
+  m_forward.clear();
+  m_stack.assign(1, start);
+  m_nodes[start].mark = m_epoch;
+  m_nodes[start].parent = NoSlot;
+  m_forward.push_back(start);
+
+  while (!m_stack.empty())
+  {
+    auto slot = m_stack.back();
+    m_stack.pop_back();
+
+    for (auto next : m_nodes[slot].out)
+    {
+      if (next == target)
+      {
+        if (cycle)
+        {
+          cycle->clear();
+          for (auto it = slot; it != NoSlot; it = m_nodes[it].parent)
+            cycle->push_back(m_nodes[it].tr);
+          cycle->push_back(m_nodes[target].tr);
+          std::reverse(cycle->begin(), cycle->end());
+        }
+        return true;
+      }
+
+      auto& n = m_nodes[next];
+      if (n.ord < ub && n.mark != m_epoch)
+      {
+        n.mark = m_epoch;
+        n.parent = slot;
+        m_forward.push_back(next);
+        m_stack.push_back(next);
+      }
+    }
+  }
   return false;
 }
 
+void WaitForGraph::searchBackward(Slot start, usize lb)
+{
+  m_backward.clear();
+  m_stack.assign(1, start);
+  m_nodes[start].mark = m_epoch;
+  m_backward.push_back(start);
+
+  while (!m_stack.empty())
+  {
+    auto slot = m_stack.back();
+    m_stack.pop_back();
+
+    for (auto prev : m_nodes[slot].in)
+    {
+      auto& n = m_nodes[prev];
+      if (n.ord > lb && n.mark != m_epoch)
+      {
+        n.mark = m_epoch;
+        m_backward.push_back(prev);
+        m_stack.push_back(prev);
+      }
+    }
+  }
+}
+
+void WaitForGraph::reorder()
+{
+  auto byOrd = [this](Slot a, Slot b) { return m_nodes[a].ord < m_nodes[b].ord; };
+  std::sort(m_backward.begin(), m_backward.end(), byOrd);
+  std::sort(m_forward.begin(), m_forward.end(), byOrd);
+
+  m_ords.clear();
+  for (auto* slots : { &m_backward, &m_forward })
+    for (auto slot : *slots)
+      m_ords.push_back(m_nodes[slot].ord);
+  std::sort(m_ords.begin(), m_ords.end());
+
+  usize i = 0;
+  for (auto* slots : { &m_backward, &m_forward })
+    for (auto slot : *slots)
+      m_nodes[slot].ord = m_ords[i++];
+}
+
+void WaitForGraph::rebuildOrder()
+{
+  // Kahn: as posições seguem a ordem em que os nós ficam sem predecessores
+  std::vector<usize> pending(m_nodes.size(), 0);
+  m_stack.clear();
+  for (auto& [tr, slot] : m_index)
+  {
+    pending[slot] = m_nodes[slot].in.size();
+    if (!pending[slot])
+      m_stack.push_back(slot);
+  }
+
+  m_frontOrd = npos / 2;
+  m_backOrd = npos / 2 + 1;
+  while (!m_stack.empty())
+  {
+    auto slot = m_stack.back();
+    m_stack.pop_back();
+    m_nodes[slot].ord = m_backOrd++;
+
+    for (auto next : m_nodes[slot].out)
+      if (--pending[next] == 0)
+        m_stack.push_back(next);
+  }
+  m_ordered = true;
+}
+
+void WaitForGraph::unlink(std::vector<Slot>& edges, Slot slot)
+{
+  auto it = std::find(edges.begin(), edges.end(), slot);
+  if (it == edges.end())
+    return;
+
+  *it = edges.back();
+  edges.pop_back();
+}
+
 } // namespace sgbd
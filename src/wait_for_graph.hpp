@@ -2,52 +2,141 @@
 
 #include "common.hpp"
 
-#include <unordered_set>
 #include <unordered_map>
+#include <vector>
 
 namespace sgbd
 {
 
 /// @brief Grafo de espera de transações.
+///
+/// Mantém uma ordem topológica dos nós (Pearce-Kelly), de modo que inserir
+/// uma aresta só revisita a região entre as posições dos seus extremos. Os nós
+/// ocupam índices densos com listas de adjacência de saída e de entrada, então
+/// remover uma transação custa O(grau de entrada + grau de saída).
 class WaitForGraph
 {
  public:
   /// @brief Adiciona uma aresta no grafo de espera onde ti -> tj.
   /// @param ti ID da transação i.
   /// @param tj ID da transação j.
+  /// @param cycle Se não for nulo, recebe os membros do ciclo encontrado
+  /// (ti, tj e o caminho tj -> ... -> ti).
   /// @return true se foi possível adicionar e false se houve ciclo.
-  bool add(usize ti, usize tj);
+  bool add(usize ti, usize tj, std::vector<usize>* cycle = nullptr);
+
+  /// @brief Adiciona a aresta ti -> tj sem procurar ciclos. Usado pela
+  /// detecção periódica; os ciclos são encontrados depois por findCycles.
+  /// @param ti ID da transação i.
+  /// @param tj ID da transação j.
+  void link(usize ti, usize tj);
+
+  /// @brief Encontra todos os ciclos em uma única passada (Tarjan).
+  /// @return Componentes fortemente conexos com mais de uma transação.
+  auto findCycles() -> std::vector<std::vector<usize>>;
 
   /// @brief Remove uma transação do grafo.
   /// @param tr ID da transação.
-  /// @return conjunto de transações que esperavam pela removida.
-  auto remove(usize tr) -> std::unordered_set<usize>;
+  /// @return transações que esperavam pela removida.
+  auto remove(usize tr) -> std::vector<usize>;
+
+  /// @brief Remove as arestas de saída da transação, mantendo o nó.
+  /// @param tr ID da transação que deixou de esperar.
+  void clearOut(usize tr);
 
   /// @brief Verifica se uma transação i espera por j.
   /// @param ti ID da transação i.
   /// @param tj ID da transação j.
   /// @return true se i depende de j.
-  bool waitsFor(usize ti, usize tj);
+  bool waitsFor(usize ti, usize tj) const;
 
   /// @brief Verifica se a transação espera por alguma outra.
   /// @param tr ID da transação
   /// @return true se tr esperar por outra transação qualquer.
-  bool waitsForAny(usize tr);
+  bool waitsForAny(usize tr) const;
+
+  /// @brief Quantidade de transações no grafo.
+  usize size() const { return m_index.size(); }
 
-  const std::unordered_map<usize, std::unordered_set<usize>>& getNodes() const
+  /// @brief Visita cada transação com as transações pelas quais ela espera.
+  /// @param fn Função (usize tr, const std::vector<usize>& waitsFor).
+  template <class Fn>
+  void forEach(Fn&& fn) const;
+
+ private:
+  using Slot = uint;
+
+  static constexpr Slot NoSlot = Slot(-1);
+
+  struct Node
   {
-    return m_nodes;
-  }
+    usize tr;
+    usize ord;               ///< Posição na ordem topológica.
+    std::vector<Slot> out;   ///< Transações pelas quais espera.
+    std::vector<Slot> in;    ///< Transações que esperam por esta.
+    usize mark = 0;          ///< Última busca que visitou o nó.
+    Slot parent = NoSlot;    ///< Predecessor na busca, para montar o ciclo.
+  };
 
  private:
-  /// @brief Verifica se existe um ciclo entre start e end.
+  /// @brief Busca ou cria o nó da transação. Um nó novo não tem arestas e
+  /// pode ocupar qualquer posição: no início se vai esperar (front) ou no fim
+  /// se vai ser esperado.
+  auto node(usize tr, bool front) -> Slot;
+
+  auto find(usize tr) const -> Slot;
+
+  /// @brief Busca em profundidade a partir de start pelos nós com posição até
+  /// ub, seguindo as arestas de saída.
   /// @param start
-  /// @param end
-  /// @return true se start -> ... -> end.
-  bool hasCycle(usize start, usize end);
+  /// @param ub Limite superior da região afetada.
+  /// @param target Nó cujo alcance indica ciclo.
+  /// @param cycle Recebe o caminho start -> ... -> target se houver ciclo.
+  /// @return true se target foi alcançado.
+  bool searchForward(Slot start, usize ub, Slot target, std::vector<usize>* cycle);
+
+  /// @brief Busca em profundidade a partir de start pelos nós com posição a
+  /// partir de lb, seguindo as arestas de entrada.
+  void searchBackward(Slot start, usize lb);
+
+  /// @brief Reatribui as posições da região afetada: primeiro os nós que
+  /// alcançam ti, depois os alcançáveis a partir de tj.
+  void reorder();
+
+  /// @brief Recalcula a ordem topológica depois de arestas adicionadas por
+  /// link (o grafo não pode ter ciclos).
+  void rebuildOrder();
+
+  static void unlink(std::vector<Slot>& edges, Slot slot);
 
  private:
-  std::unordered_map<usize, std::unordered_set<usize>> m_nodes;
+  std::vector<Node> m_nodes;
+  std::vector<Slot> m_free;
+  std::unordered_map<usize, Slot> m_index;
+
+  bool m_ordered = true;
+  usize m_frontOrd = npos / 2;
+  usize m_backOrd = npos / 2 + 1;
+
+  // estado das buscas, reaproveitado entre inserções
+  usize m_epoch = 0;
+  std::vector<Slot> m_stack;
+  std::vector<Slot> m_forward;
+  std::vector<Slot> m_backward;
+  std::vector<usize> m_ords;
 };
 
+template <class Fn>
+void WaitForGraph::forEach(Fn&& fn) const
+{
+  std::vector<usize> waitsFor;
+  for (auto& [tr, slot] : m_index)
+  {
+    waitsFor.clear();
+    for (auto next : m_nodes[slot].out)
+      waitsFor.push_back(m_nodes[next].tr);
+    fn(tr, waitsFor);
+  }
+}
+
 } // namespace sgbd